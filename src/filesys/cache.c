@@ -0,0 +1,326 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in the cache. */
+#define CACHE_SIZE 64
+
+/* Ticks between write-behinds of dirty sectors. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* Most sectors waiting to be read ahead. */
+#define READ_AHEAD_MAX 32
+
+/* A cached disk sector. */
+struct cache_entry
+  {
+    disk_sector_t sector;       /* Sector number, if IN_USE. */
+    bool in_use;                /* Holds a sector? */
+    bool busy;                  /* Being read or written? */
+    bool dirty;                 /* Differs from the disk? */
+    bool accessed;              /* Used since the clock hand passed? */
+    uint8_t *data;              /* DISK_SECTOR_SIZE bytes. */
+  };
+
+/* Sector cache, replaced with the clock algorithm.  All of it is
+   protected by cache_lock.  Disk I/O happens without the lock,
+   with the entry marked busy.  Busy entries are neither used nor
+   replaced; cache_cond is broadcast when their I/O is done. */
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_cond;
+static size_t clock_hand;
+
+/* Sectors to read ahead, a circular queue protected by
+   cache_lock.  The read-ahead thread waits on read_ahead_cond
+   for sectors. */
+static disk_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head;
+static size_t read_ahead_cnt;
+static struct condition read_ahead_cond;
+
+/* Statistics. */
+static long long hit_cnt;             /* # of accesses in the cache. */
+static long long miss_cnt;            /* # of sectors read in. */
+static long long write_cnt;           /* # of dirty sectors written. */
+static long long ahead_cnt;           /* # of sectors read ahead. */
+
+static struct cache_entry *lookup_entry (disk_sector_t sector);
+static struct cache_entry *get_entry (disk_sector_t sector, bool read);
+static void write_back (struct cache_entry *e);
+static void flush_daemon (void *aux UNUSED);
+static void read_ahead_daemon (void *aux UNUSED);
+
+/* Initializes the buffer cache and starts writing dirty sectors
+   behind and reading sectors ahead. */
+void
+cache_init (void)
+{
+  uint8_t *pages;
+  size_t i;
+
+  pages = palloc_get_multiple (PAL_ASSERT,
+                               CACHE_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+  for (i = 0; i < CACHE_SIZE; i++)
+    cache[i].data = pages + i * DISK_SECTOR_SIZE;
+  lock_init (&cache_lock);
+  cond_init (&cache_cond);
+  cond_init (&read_ahead_cond);
+
+  thread_create ("flush", PRI_DEFAULT, flush_daemon, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER.
+   BUFFER may be in user memory, which is copied to without holding
+   any lock, so that page faults can be handled. */
+void
+cache_read (disk_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  if (is_user_vaddr (buffer))
+    {
+      /* Copying into user memory may fault, which must not happen
+         with cache_lock held, so go through a bounce buffer. */
+      uint8_t bounce[DISK_SECTOR_SIZE];
+
+      cache_read (sector, bounce, ofs, size);
+      memcpy (buffer, bounce, size);
+      return;
+    }
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER, which may be in user memory, at
+   offset OFS within SECTOR.  The sector reaches the disk later, see
+   cache_flush(). */
+void
+cache_write (disk_sector_t sector, const void *buffer, size_t ofs,
+             size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  if (is_user_vaddr (buffer))
+    {
+      /* As in cache_read(). */
+      uint8_t bounce[DISK_SECTOR_SIZE];
+
+      memcpy (bounce, buffer, size);
+      cache_write (sector, bounce, ofs, size);
+      return;
+    }
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < DISK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   because it is about to be read.  Does nothing if the sector is
+   cached already, or if too many sectors are waiting. */
+void
+cache_read_ahead (disk_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX && lookup_entry (sector) == NULL)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt) % READ_AHEAD_MAX;
+
+      read_ahead_queue[tail] = sector;
+      read_ahead_cnt++;
+      cond_signal (&read_ahead_cond, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes all dirty sectors to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      while (cache[i].busy)
+        cond_wait (&cache_cond, &cache_lock);
+      write_back (&cache[i]);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %lld hits, %lld misses, %lld writes, "
+          "%lld sectors read ahead\n",
+          hit_cnt, miss_cnt, write_cnt, ahead_cnt);
+}
+
+/* Returns the cache entry for SECTOR, or a null pointer if it is
+   not cached. */
+static struct cache_entry *
+lookup_entry (disk_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].in_use && cache[i].sector == sector)
+      return &cache[i];
+
+  return NULL;
+}
+
+/* Returns the cache entry for SECTOR, which is not busy, evicting
+   another sector if it is not cached.  Its contents are read from
+   disk if READ is true; otherwise the caller overwrites all of
+   them.  Releases cache_lock while waiting for I/O. */
+static struct cache_entry *
+get_entry (disk_sector_t sector, bool read)
+{
+  struct cache_entry *e;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (;;)
+    {
+      e = lookup_entry (sector);
+      if (e != NULL)
+        {
+          if (!e->busy)
+            {
+              e->accessed = true;
+              hit_cnt++;
+              return e;
+            }
+          cond_wait (&cache_cond, &cache_lock);
+          continue;
+        }
+
+      /* Clock algorithm.  Unused entries have not been accessed.
+         Two sweeps find a victim unless all entries are busy. */
+      e = NULL;
+      for (i = 0; i < 2 * CACHE_SIZE && e == NULL; i++)
+        {
+          struct cache_entry *c = &cache[clock_hand];
+
+          clock_hand = (clock_hand + 1) % CACHE_SIZE;
+          if (c->busy)
+            continue;
+          if (!c->accessed)
+            e = c;
+          else
+            c->accessed = false;
+        }
+      if (e == NULL)
+        {
+          cond_wait (&cache_cond, &cache_lock);
+          continue;
+        }
+
+      if (!e->dirty)
+        break;
+
+      /* Write the victim back, then start over: meanwhile SECTOR
+         may have been cached, or the victim used again. */
+      write_back (e);
+    }
+
+  e->in_use = true;
+  e->sector = sector;
+  e->accessed = true;
+  miss_cnt++;
+  if (read)
+    {
+      e->busy = true;
+      lock_release (&cache_lock);
+      disk_read (filesys_disk, sector, e->data);
+      lock_acquire (&cache_lock);
+      e->busy = false;
+      cond_broadcast (&cache_cond, &cache_lock);
+    }
+
+  return e;
+}
+
+/* Writes cache entry E, which is not busy, to disk if it is
+   dirty.  Releases cache_lock during the write. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  ASSERT (!e->busy);
+
+  if (e->in_use && e->dirty)
+    {
+      e->busy = true;
+      lock_release (&cache_lock);
+      disk_write (filesys_disk, e->sector, e->data);
+      lock_acquire (&cache_lock);
+      e->busy = false;
+      e->dirty = false;
+      write_cnt++;
+      cond_broadcast (&cache_cond, &cache_lock);
+    }
+}
+
+/* Write-behind thread.  Writes dirty sectors to disk now and then,
+   so that few are lost if the machine stops without
+   filesys_done(). */
+static void
+flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread.  Reads the sectors queued by
+   cache_read_ahead() into the cache, while their readers are busy
+   with the sectors before them. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      disk_sector_t sector;
+
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &cache_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+
+      if (lookup_entry (sector) == NULL)
+        {
+          get_entry (sector, true);
+          ahead_cnt++;
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -21,6 +22,37 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Large directories are kept as hash tables.  The first entry of
+   such a directory is a header, and the remaining entries are the
+   slots of an open-addressed table, probed linearly from the hash
+   of the name.  A free slot whose name is empty has never been
+   used and ends a probe sequence; one with a name is the remains
+   of a removed entry.  The table may end before the directory
+   does, since directories never shrink.
+
+   The header looks like a free entry, so dir_readdir() passes over
+   it just as it does for linear directories, which stay in the
+   original format until they grow past DIR_INDEX_MIN entries. */
+struct dir_header
+  {
+    disk_sector_t magic;                /* DIR_INDEX_MAGIC. */
+    uint32_t slot_cnt;                  /* Number of slots. */
+    uint32_t used_cnt;                  /* Slots in use or removed. */
+    char unused[NAME_MAX + 1 - 2 * sizeof (uint32_t)];
+    bool in_use;                        /* Always false. */
+  };
+
+/* Identifies a hashed directory. */
+#define DIR_INDEX_MAGIC 0x48524944
+
+/* Number of entries a linear directory may have before it is
+   converted into a hash table. */
+#define DIR_INDEX_MIN 64
+
+static bool read_header (const struct dir *, struct dir_header *);
+static bool build_index (struct dir *);
+static bool clear_entries (struct dir *, off_t start, off_t end);
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -83,6 +115,58 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns the byte offset of slot IDX in a hashed directory. */
+static off_t
+slot_ofs (size_t idx)
+{
+  return (idx + 1) * sizeof (struct dir_entry);
+}
+
+/* Searches hashed directory DIR, whose header is H, for NAME,
+   following its probe sequence.  Returns true and sets *EP and
+   *OFSP as lookup() does if it is found.  Otherwise returns false
+   and sets *FREEP, if FREEP is non-null, to the offset of the
+   first free slot in the sequence, or to -1 if the table has no
+   free slot. */
+static bool
+index_lookup (const struct dir *dir, const struct dir_header *h,
+              const char *name, struct dir_entry *ep, off_t *ofsp,
+              off_t *freep)
+{
+  size_t cnt = h->slot_cnt;
+  size_t idx = hash_string (name) % cnt;
+  size_t i;
+
+  if (freep != NULL)
+    *freep = -1;
+  for (i = 0; i < cnt; i++, idx = (idx + 1) % cnt)
+    {
+      struct dir_entry e;
+      off_t ofs = slot_ofs (idx);
+
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        break;
+      if (e.in_use)
+        {
+          if (!strcmp (name, e.name))
+            {
+              if (ep != NULL)
+                *ep = e;
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              return true;
+            }
+          continue;
+        }
+
+      if (freep != NULL && *freep == -1)
+        *freep = ofs;
+      if (e.name[0] == '\0')
+        break;
+    }
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,12 +176,16 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    return index_lookup (dir, &h, name, ep, ofsp, NULL);
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -141,6 +229,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -156,18 +245,52 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Rebuild the table of a hashed directory, larger if need be,
+     before it is half full of live and removed entries.  If that
+     fails, NAME may still fit into the old table. */
+  if (read_header (dir, &h) && (h.used_cnt + 1) * 2 > h.slot_cnt)
+    build_index (dir);
+
+  if (!read_header (dir, &h))
+    {
+      /* Set OFS to offset of free slot.
+         If there are no free slots, then it will be set to the
+         current end-of-file.
+         
+         inode_read_at() will only return a short read at end of
+         file.  Otherwise, we'd need to verify that we didn't get a
+         short read due to something intermittent such as low
+         memory. */
+      for (ofs = 0;
+           inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+           ofs += sizeof e) 
+        if (!e.in_use)
+          break;
+
+      /* Keep small directories linear, and turn a full one that
+         has outgrown that into a hash table.  If that fails, the
+         directory is still linear and NAME goes at its old end. */
+      if (ofs < inode_length (dir->inode)
+          || ofs / sizeof e < DIR_INDEX_MIN
+          || !build_index (dir) || !read_header (dir, &h))
+        goto write;
+    }
+
+  /* Take the first free slot in NAME's probe sequence.  Removed
+     entries are reused as they are met, so only a slot that was
+     never used adds to the count. */
+  index_lookup (dir, &h, name, NULL, NULL, &ofs);
+  if (ofs == -1
+      || inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+    goto done;
+  if (e.name[0] == '\0')
+    {
+      h.used_cnt++;
+      if (inode_write_at (dir->inode, &h, sizeof h, 0) != sizeof h)
+        goto done;
+    }
 
+ write:
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
@@ -234,3 +357,106 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Reads the header of DIR into *H.  Returns true if DIR is a
+   hashed directory, false if it is linear. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_INDEX_MAGIC && !h->in_use);
+}
+
+/* Rewrites DIR, linear or hashed, as a hash table holding its
+   current entries.  The table keeps to the directory's length if
+   that leaves it at most a quarter full, and otherwise doubles
+   until it does.
+
+   The directory is first extended to the table's size, which is
+   the only step that allocates disk space.  If that fails, DIR
+   is left as it was; if writing the table fails anyway, DIR is
+   rewritten as a linear directory with the same entries.
+   Returns true if successful, false on failure. */
+static bool
+build_index (struct dir *dir)
+{
+  struct dir_header h;
+  struct dir_entry e, *entries;
+  size_t max_cnt, entry_cnt, cnt, i;
+  off_t ofs, length;
+  bool success = false;
+
+  ASSERT (sizeof h == sizeof e);
+
+  /* Gather the live entries. */
+  length = inode_length (dir->inode);
+  max_cnt = length / sizeof e;
+  entries = malloc (max_cnt * sizeof *entries);
+  if (entries == NULL)
+    return false;
+  entry_cnt = 0;
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use)
+      entries[entry_cnt++] = e;
+
+  /* Size the table, and make room for it.  Both formats ignore
+     free entries past their end. */
+  cnt = max_cnt > 1 ? max_cnt - 1 : 1;
+  while ((entry_cnt + 1) * 4 > cnt)
+    cnt *= 2;
+  if (!clear_entries (dir, length, slot_ofs (cnt)))
+    goto done;
+
+  /* Clear every slot, then write the entries and, last, the
+     header. */
+  if (!clear_entries (dir, 0, slot_ofs (cnt)))
+    goto restore;
+  memset (&h, 0, sizeof h);
+  h.magic = DIR_INDEX_MAGIC;
+  h.slot_cnt = cnt;
+  h.used_cnt = entry_cnt;
+  h.in_use = false;
+  for (i = 0; i < entry_cnt; i++)
+    {
+      index_lookup (dir, &h, entries[i].name, NULL, NULL, &ofs);
+      if (ofs == -1 || (inode_write_at (dir->inode, &entries[i], sizeof e, ofs)
+                        != sizeof e))
+        goto restore;
+    }
+  if (inode_write_at (dir->inode, &h, sizeof h, 0) != sizeof h)
+    goto restore;
+  success = true;
+  goto done;
+
+ restore:
+  /* Put the entries back in a row, over space that is already
+     allocated. */
+  clear_entries (dir, 0, sizeof e);
+  for (i = 0; i < entry_cnt; i++)
+    inode_write_at (dir->inode, &entries[i], sizeof e, i * sizeof e);
+  clear_entries (dir, entry_cnt * sizeof e, slot_ofs (cnt));
+
+ done:
+  free (entries);
+  return success;
+}
+
+/* Writes free entries to DIR from byte offset START up to END.
+   Returns true if successful, false on failure. */
+static bool
+clear_entries (struct dir *dir, off_t start, off_t end)
+{
+  static const uint8_t zeros[DISK_SECTOR_SIZE];
+
+  while (start < end)
+    {
+      off_t chunk = end - start;
+      if (chunk > (off_t) sizeof zeros)
+        chunk = sizeof zeros;
+      if (inode_write_at (dir->inode, zeros, chunk, start) != chunk)
+        return false;
+      start += chunk;
+    }
+  return true;
+}
@@ -1,16 +1,26 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/disk.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Range of the read-ahead window, in sectors. */
+#define READ_AHEAD_MIN 2
+#define READ_AHEAD_MAX 16
+
 /* An open file. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_pos;               /* Where a sequential read would start. */
+    off_t ra_end;               /* End of the sectors read ahead. */
+    off_t ra_window;            /* Sectors to read ahead, 0 if random. */
   };
 
+static void read_ahead (struct file *file, off_t ofs, off_t size);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -69,6 +79,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  read_ahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,7 +92,9 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -166,3 +179,38 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Notes that SIZE bytes at offset OFS have been read from FILE.
+   A read that continues where the last one ended has the sectors
+   after it read into the cache in the background.  Their number
+   doubles with every further sequential read, up to
+   READ_AHEAD_MAX, and drops back to none on any other read. */
+static void
+read_ahead (struct file *file, off_t ofs, off_t size)
+{
+  off_t end = ofs + size;
+  off_t ra_end;
+
+  if (size == 0)
+    return;
+
+  if (ofs != file->ra_pos)
+    {
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
+  else if (file->ra_window < READ_AHEAD_MAX)
+    file->ra_window = (file->ra_window == 0 ? READ_AHEAD_MIN
+                       : file->ra_window * 2);
+  file->ra_pos = end;
+
+  /* Skip the sectors asked for by earlier reads. */
+  ra_end = end + file->ra_window * DISK_SECTOR_SIZE;
+  if (file->ra_end > end)
+    end = file->ra_end;
+  if (end < ra_end)
+    {
+      inode_read_ahead (file->inode, ra_end - end, end);
+      file->ra_end = ra_end;
+    }
+}
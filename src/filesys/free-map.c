@@ -39,6 +39,48 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp)
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates a run of up to *CNT consecutive sectors, preferring
+   longer runs and runs at or after sector HINT, and stores the
+   first into *SECTORP and their number into *CNT.
+   Returns true if successful, false if all sectors were
+   in use. */
+bool
+free_map_allocate_run (disk_sector_t hint, size_t *cnt,
+                       disk_sector_t *sectorp)
+{
+  for (; *cnt > 0; *cnt /= 2)
+    {
+      disk_sector_t sector = bitmap_scan (free_map, hint, *cnt, false);
+
+      if (sector == BITMAP_ERROR)
+        sector = bitmap_scan (free_map, 0, *cnt, false);
+      if (sector != BITMAP_ERROR && free_map_allocate_at (sector, *cnt))
+        {
+          *sectorp = sector;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Allocates the CNT sectors starting at SECTOR, if they are all
+   available.  Returns true if successful. */
+bool
+free_map_allocate_at (disk_sector_t sector, size_t cnt)
+{
+  if (sector + cnt > bitmap_size (free_map)
+      || !bitmap_none (free_map, sector, cnt))
+    return false;
+
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+    {
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      return false;
+    }
+  return true;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt)
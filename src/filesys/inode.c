@@ -2,7 +2,9 @@
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
@@ -10,14 +12,58 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of extents in an inode.  Further extents go into a
+   chain of extent blocks. */
+#define INODE_EXTENTS 40
+
+/* Number of sectors reserved for a file that is being appended
+   to, so that it stays contiguous on disk. */
+#define PREALLOC_CNT 16
+
+/* A run of consecutive blocks of a file in consecutive sectors. */
+struct extent
+  {
+    uint32_t block;                     /* First block in the file. */
+    disk_sector_t start;                /* Sector of the first block. */
+    uint32_t cnt;                       /* Number of blocks. */
+  };
+
 /* On-disk inode.
-   Must be exactly DISK_SECTOR_SIZE bytes long. */
+   Must be exactly DISK_SECTOR_SIZE bytes long.
+
+   The file's data is described by EXTENT_CNT extents, sorted by
+   their first block.  Blocks in no extent are holes, which read
+   as zeros and take no space on disk. */
 struct inode_disk
   {
-    disk_sector_t start;                /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Number of extents. */
+    disk_sector_t next;                 /* First extent block, or 0. */
+    struct extent extents[INODE_EXTENTS]; /* First extents. */
+    uint32_t unused[4];                 /* Not used. */
+  };
+
+/* Number of extents in an extent block. */
+#define BLOCK_EXTENTS 42
+
+/* Extent block, holding the extents after the inode's own.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block
+  {
+    disk_sector_t next;                 /* Next extent block, or 0. */
+    struct extent extents[BLOCK_EXTENTS]; /* Extents. */
+    uint32_t unused[1];                 /* Not used. */
+  };
+
+/* The extent block visited last in a chain, so that the next
+   visit to it or to a later block need not start at the head of
+   the chain.  Extent blocks stay in place until the file is
+   deleted. */
+struct chain_pos
+  {
+    size_t idx;                         /* Position in the chain. */
+    disk_sector_t sector;               /* Its sector, or 0 if none. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -36,21 +82,423 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    size_t last_extent;                 /* Extent of the last lookup. */
+    struct chain_pos chain;             /* Extent block visited last. */
+    disk_sector_t prealloc_start;       /* Sectors reserved for appends. */
+    size_t prealloc_cnt;                /* Number of sectors reserved. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns the extent block that follows the one in SECTOR, or the
+   first one if SECTOR is 0, in the chain of the file DISK
+   describes.  If ALLOCATE is true, a missing extent block is
+   allocated and *CHANGED is set if DISK itself changes.  Returns
+   0 if there is no such extent block. */
+static disk_sector_t
+next_extent_block (struct inode_disk *disk, disk_sector_t sector,
+                   bool allocate, bool *changed)
+{
+  disk_sector_t next;
+
+  if (sector == 0)
+    next = disk->next;
+  else
+    cache_read (sector, &next, offsetof (struct extent_block, next),
+                sizeof next);
+
+  if (next == 0 && allocate)
+    {
+      static struct extent_block empty;
+
+      if (!free_map_allocate (1, &next))
+        return 0;
+      cache_write (next, &empty, 0, DISK_SECTOR_SIZE);
+      if (sector == 0)
+        {
+          disk->next = next;
+          *changed = true;
+        }
+      else
+        cache_write (sector, &next, offsetof (struct extent_block, next),
+                     sizeof next);
+    }
+
+  return next;
+}
+
+/* Returns the sector of the extent block that holds extent IDX
+   of the file DISK describes, where IDX is not in the inode
+   itself, and stores IDX's position in the block in *OFS.  The
+   chain is followed from *POS if that is no later than the block
+   wanted, and *POS is updated.  If ALLOCATE is true, missing
+   extent blocks are allocated and *CHANGED is set if DISK itself
+   changes.  Returns 0 if there is no such extent block. */
+static disk_sector_t
+extent_block (struct inode_disk *disk, struct chain_pos *pos, size_t idx,
+              size_t *ofs, bool allocate, bool *changed)
+{
+  disk_sector_t sector;
+  size_t i, n;
+
+  ASSERT (idx >= INODE_EXTENTS);
+  idx -= INODE_EXTENTS;
+  *ofs = idx % BLOCK_EXTENTS;
+  n = idx / BLOCK_EXTENTS;
+
+  if (pos->sector != 0 && pos->idx <= n)
+    {
+      i = pos->idx;
+      sector = pos->sector;
+    }
+  else
+    {
+      i = 0;
+      sector = next_extent_block (disk, 0, allocate, changed);
+    }
+  for (; sector != 0 && i < n; i++)
+    sector = next_extent_block (disk, sector, allocate, changed);
+
+  if (sector != 0)
+    {
+      pos->idx = n;
+      pos->sector = sector;
+    }
+  return sector;
+}
+
+/* Reads extent IDX of the file DISK describes into *E.  POS is as
+   for extent_block(). */
+static void
+get_extent (struct inode_disk *disk, struct chain_pos *pos, size_t idx,
+            struct extent *e)
+{
+  size_t ofs;
+  disk_sector_t sector;
+  bool changed = false;
+
+  ASSERT (idx < disk->extent_cnt);
+
+  if (idx < INODE_EXTENTS)
+    {
+      *e = disk->extents[idx];
+      return;
+    }
+
+  sector = extent_block (disk, pos, idx, &ofs, false, &changed);
+  ASSERT (sector != 0);
+  cache_read (sector, e, offsetof (struct extent_block, extents[ofs]),
+              sizeof *e);
+}
+
+/* Stores *E as extent IDX of the file DISK describes, which may be
+   one past the last extent.  POS is as for extent_block().  Sets
+   *CHANGED if DISK itself changes.  Returns false if an extent
+   block cannot be allocated. */
+static bool
+set_extent (struct inode_disk *disk, struct chain_pos *pos, size_t idx,
+            const struct extent *e, bool *changed)
+{
+  size_t ofs;
+  disk_sector_t sector;
+
+  ASSERT (idx <= disk->extent_cnt);
+
+  if (idx < INODE_EXTENTS)
+    disk->extents[idx] = *e;
+  else
+    {
+      sector = extent_block (disk, pos, idx, &ofs, true, changed);
+      if (sector == 0)
+        return false;
+      cache_write (sector, e, offsetof (struct extent_block, extents[ofs]),
+                   sizeof *e);
+    }
+
+  if (idx == disk->extent_cnt)
+    disk->extent_cnt++;
+  *changed = true;
+  return true;
+}
+
+/* Inserts *E as extent IDX of the file DISK describes, moving the
+   extents from IDX on up by one.  POS and CHANGED are as for
+   set_extent().  Returns false if an extent block cannot be
+   allocated, leaving the extents as they were. */
+static bool
+insert_extent (struct inode_disk *disk, struct chain_pos *pos, size_t idx,
+               const struct extent *e, bool *changed)
+{
+  size_t cnt = disk->extent_cnt;
+  struct extent moved;
+  size_t i;
+
+  ASSERT (idx <= cnt);
+
+  if (idx == cnt)
+    return set_extent (disk, pos, idx, e, changed);
+
+  /* Growing the list is the only step that can fail. */
+  get_extent (disk, pos, cnt - 1, &moved);
+  if (!set_extent (disk, pos, cnt, &moved, changed))
+    return false;
+  for (i = cnt - 1; i > idx; i--)
+    {
+      get_extent (disk, pos, i - 1, &moved);
+      set_extent (disk, pos, i, &moved, changed);
+    }
+  return set_extent (disk, pos, idx, e, changed);
+}
+
+/* Returns the number of INODE's extents that start at or before
+   block BLOCK, so that the extent holding BLOCK, if any, is the
+   one before that.  The extents being sorted, this is a binary
+   search in the inode or in the extent block whose range covers
+   BLOCK, which is found by walking the chain from the block
+   visited last if that is no later. */
+static size_t
+extents_before (struct inode *inode, size_t block)
+{
+  struct inode_disk *disk = &inode->data;
+  size_t cnt = disk->extent_cnt;
+  size_t lo = 0;
+  size_t hi = cnt < INODE_EXTENTS ? cnt : INODE_EXTENTS;
+  struct extent e;
+
+  if (cnt > INODE_EXTENTS && disk->extents[INODE_EXTENTS - 1].block <= block)
+    {
+      /* Start at the block visited last, if its first extent
+         starts at or before BLOCK, and otherwise at the head of
+         the chain.  Move on while the block's last extent does,
+         too. */
+      lo = INODE_EXTENTS;
+      if (inode->chain.sector != 0)
+        {
+          size_t first = INODE_EXTENTS + inode->chain.idx * BLOCK_EXTENTS;
+
+          get_extent (disk, &inode->chain, first, &e);
+          if (e.block <= block)
+            lo = first;
+        }
+      for (;;)
+        {
+          hi = lo + BLOCK_EXTENTS < cnt ? lo + BLOCK_EXTENTS : cnt;
+          if (hi == cnt)
+            break;
+          get_extent (disk, &inode->chain, hi - 1, &e);
+          if (e.block > block)
+            break;
+          lo = hi;
+        }
+    }
+
+  /* Find the first extent in [LO, HI) that starts after BLOCK.
+     Every extent before LO starts at or before it. */
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      get_extent (disk, &inode->chain, mid, &e);
+      if (e.block <= block)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Fills the CNT sectors starting at SECTOR with zeros. */
+static void
+zero_sectors (disk_sector_t sector, size_t cnt)
+{
+  static char zeros[DISK_SECTOR_SIZE];
+
+  for (; cnt > 0; cnt--)
+    cache_write (sector++, zeros, 0, DISK_SECTOR_SIZE);
+}
+
+/* Allocates sectors of zeros for CNT blocks of the file DISK
+   describes, starting at block BLOCK, which is past its last
+   extent, in as few extents as possible.  POS is as for
+   extent_block().  Returns false if the disk is full, leaving the
+   extents allocated so far in DISK. */
+static bool
+allocate_blocks (struct inode_disk *disk, struct chain_pos *pos,
+                 size_t block, size_t cnt)
+{
+  disk_sector_t hint = 0;
+  bool changed;
+
+  while (cnt > 0)
+    {
+      struct extent e;
+      size_t run = cnt;
+
+      if (!free_map_allocate_run (hint, &run, &e.start))
+        return false;
+      e.block = block;
+      e.cnt = run;
+      if (!set_extent (disk, pos, disk->extent_cnt, &e, &changed))
+        {
+          free_map_release (e.start, run);
+          return false;
+        }
+      zero_sectors (e.start, run);
+
+      block += run;
+      cnt -= run;
+      hint = e.start + run;
+    }
+
+  return true;
+}
+
+/* Releases the sectors reserved for appends to INODE. */
+static void
+release_prealloc (struct inode *inode)
+{
+  if (inode->prealloc_cnt > 0)
+    free_map_release (inode->prealloc_start, inode->prealloc_cnt);
+  inode->prealloc_cnt = 0;
+}
+
+/* Allocates a sector of zeros for block BLOCK of INODE, which is
+   a hole, and writes INODE's on-disk inode back.  IDX is the
+   number of extents that start before BLOCK, see
+   extents_before().  A block right after the extent before it
+   extends that extent if the sector after the extent is free.  A
+   block appended to the file otherwise starts a new extent with
+   the following PREALLOC_CNT - 1 sectors reserved, so that further
+   appends can extend it.
+   Returns the sector, or 0 if the disk is full. */
+static disk_sector_t
+allocate_block (struct inode *inode, size_t block, size_t idx)
+{
+  struct inode_disk *disk = &inode->data;
+  bool append = block >= bytes_to_sectors (disk->length);
+  disk_sector_t hint = 0;
+  bool changed = false;
+  struct extent e;
+  size_t cnt;
+
+  if (idx > 0)
+    {
+      get_extent (disk, &inode->chain, idx - 1, &e);
+      hint = e.start + e.cnt;
+      if (e.block + e.cnt == block)
+        {
+          bool extended = false;
+
+          if (inode->prealloc_cnt > 0 && inode->prealloc_start == hint)
+            {
+              inode->prealloc_start++;
+              inode->prealloc_cnt--;
+              extended = true;
+            }
+          else
+            extended = free_map_allocate_at (hint, 1);
+
+          if (extended)
+            {
+              e.cnt++;
+              set_extent (disk, &inode->chain, idx - 1, &e, &changed);
+              zero_sectors (hint, 1);
+              cache_write (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+              inode->last_extent = idx - 1;
+              return hint;
+            }
+        }
+    }
+
+  /* Start a new extent. */
+  release_prealloc (inode);
+  cnt = append ? PREALLOC_CNT : 1;
+  if (!free_map_allocate_run (hint, &cnt, &e.start))
+    return 0;
+  e.block = block;
+  e.cnt = 1;
+  if (!insert_extent (disk, &inode->chain, idx, &e, &changed))
+    {
+      free_map_release (e.start, cnt);
+      return 0;
+    }
+  if (cnt > 1)
+    {
+      inode->prealloc_start = e.start + 1;
+      inode->prealloc_cnt = cnt - 1;
+    }
+  zero_sectors (e.start, 1);
+  if (changed)
+    cache_write (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+  inode->last_extent = idx;
+
+  return e.start;
+}
+
 /* Returns the disk sector that contains byte offset POS within
-   INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   INODE, or 0 if it is in a hole or beyond the end of the file.
+   If ALLOCATE is true, a hole is filled with a new sector, and 0
+   means that the disk is full. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, bool allocate) 
 {
+  struct inode_disk *disk = &inode->data;
+  size_t block = pos / DISK_SECTOR_SIZE;
+  struct extent e;
+  size_t idx;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / DISK_SECTOR_SIZE;
-  else
-    return -1;
+  if (pos >= disk->length && !allocate)
+    return 0;
+
+  /* Sequential access stays within one extent, so try the one
+     found last time first. */
+  if (inode->last_extent < disk->extent_cnt)
+    {
+      get_extent (disk, &inode->chain, inode->last_extent, &e);
+      if (block >= e.block && block - e.block < e.cnt)
+        return e.start + (block - e.block);
+    }
+
+  idx = extents_before (inode, block);
+  if (idx > 0)
+    {
+      get_extent (disk, &inode->chain, idx - 1, &e);
+      if (block - e.block < e.cnt)
+        {
+          inode->last_extent = idx - 1;
+          return e.start + (block - e.block);
+        }
+    }
+
+  return allocate ? allocate_block (inode, block, idx) : 0;
+}
+
+/* Releases all the sectors of the file that DISK describes,
+   except the inode's own. */
+static void
+release_blocks (struct inode_disk *disk)
+{
+  struct chain_pos pos = {0, 0};
+  disk_sector_t sector;
+  size_t i;
+
+  for (i = 0; i < disk->extent_cnt; i++)
+    {
+      struct extent e;
+
+      get_extent (disk, &pos, i, &e);
+      free_map_release (e.start, e.cnt);
+    }
+
+  for (sector = disk->next; sector != 0; )
+    {
+      disk_sector_t next;
+
+      cache_read (sector, &next, offsetof (struct extent_block, next),
+                  sizeof next);
+      free_map_release (sector, 1);
+      sector = next;
+    }
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -64,6 +512,19 @@ inode_init (void)
   list_init (&open_inodes);
 }
 
+/* Shuts down the inode module.  Releases the sectors reserved for
+   appends to inodes that are still open, which would otherwise
+   stay allocated on disk. */
+void
+inode_done (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    release_prealloc (list_entry (e, struct inode, elem));
+}
+
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
    disk.
@@ -80,26 +541,24 @@ inode_create (disk_sector_t sector, off_t length)
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+  ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
 
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      struct chain_pos pos = {0, 0};
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start))
-        {
-          disk_write (filesys_disk, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[DISK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                disk_write (filesys_disk, disk_inode->start + i, zeros); 
-            }
-          success = true; 
-        } 
+
+      /* Files start out without holes, so that writes within
+         their initial size cannot run out of disk space. */
+      success = allocate_blocks (disk_inode, &pos, 0,
+                                 bytes_to_sectors (length));
+      if (success)
+        cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+      else
+        release_blocks (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -137,7 +596,10 @@ inode_open (disk_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  disk_read (filesys_disk, inode->sector, &inode->data);
+  inode->last_extent = 0;
+  inode->chain.sector = 0;
+  inode->prealloc_cnt = 0;
+  cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
   return inode;
 }
 
@@ -172,13 +634,13 @@ inode_close (struct inode *inode)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+      release_prealloc (inode);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_blocks (&inode->data);
         }
 
       free (inode); 
@@ -202,12 +664,11 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx = byte_to_sector (inode, offset, false);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,47 +681,52 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Read full sector directly into caller's buffer. */
-          disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          disk_read (filesys_disk, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Asks for the sectors of INODE that hold the SIZE bytes starting
+   at OFFSET to be read into the cache in the background, as far
+   as they are within the file. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end = offset + size;
+  off_t pos;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (pos = offset - offset % DISK_SECTOR_SIZE; pos < end;
+       pos += DISK_SECTOR_SIZE)
+    {
+      disk_sector_t sector = byte_to_sector (inode, pos, false);
+
+      if (sector != 0)
+        cache_read_ahead (sector);
+    }
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or the file would grow too
+   large.  A write past the end of file extends it; the part of
+   the file it skips over is a hole. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
@@ -268,51 +734,31 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx = byte_to_sector (inode, offset, true);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int sector_left = DISK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Write full sector directly to disk. */
-          disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            disk_read (filesys_disk, sector_idx, bounce);
-          else
-            memset (bounce, 0, DISK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          disk_write (filesys_disk, sector_idx, bounce); 
-        }
+      /* The cache reads in the rest of the sector, unless the
+         whole of it is written. */
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+    }
 
   return bytes_written;
 }
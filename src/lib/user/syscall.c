@@ -182,3 +182,21 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+bool
+memstat (struct memstat *ms)
+{
+  return syscall1 (SYS_MEMSTAT, ms);
+}
+
+bool
+vmstat (enum vm_event event, struct vmstat *vs)
+{
+  return syscall2 (SYS_VMSTAT, event, vs);
+}
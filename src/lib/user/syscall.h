@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +46,19 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+
+/* Memory usage of a process, in pages. */
+struct memstat
+  {
+    unsigned resident;          /* Pages in memory. */
+    unsigned shared;            /* Resident pages shared with others. */
+    unsigned swapped;           /* Pages in swap. */
+    unsigned rss_limit;         /* Most pages resident, or 0. */
+  };
+
+pid_t fork (void);
+bool memstat (struct memstat *);
+bool vmstat (enum vm_event, struct vmstat *);
+
 #endif /* lib/user/syscall.h */
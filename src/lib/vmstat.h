@@ -0,0 +1,32 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+/* Virtual memory events counted by the kernel, shared between
+   the kernel and user programs, see vmstat(). */
+enum vm_event
+  {
+    VM_MINOR_FAULT,             /* Page mapped without I/O. */
+    VM_SWAP_IN,                 /* Page read from swap. */
+    VM_FILE_IN,                 /* Page read from its file. */
+    VM_EVICTION,                /* Frame evicted. */
+    VM_CLOCK_SCAN,              /* Victim found, value is frames scanned. */
+    VM_STACK_GROWTH,            /* Stack grown. */
+    VM_EVENT_CNT                /* Number of events. */
+  };
+
+/* Number of buckets in a histogram.  Bucket I counts values from
+   2**I up to 2**(I+1), except that bucket 0 also counts 0 and
+   the last bucket counts all larger values. */
+#define VMSTAT_BUCKETS 32
+
+/* Statistics of an event.  Values are CPU cycles, except for
+   VM_CLOCK_SCAN. */
+struct vmstat
+  {
+    unsigned long long count;   /* Number of events. */
+    unsigned long long total;   /* Sum of values. */
+    unsigned long long max;     /* Largest value. */
+    unsigned buckets[VMSTAT_BUCKETS]; /* Histogram of values. */
+  };
+
+#endif /* lib/vmstat.h */
@@ -0,0 +1,74 @@
+/* Creates 200 files in the root directory, enough for it to be
+   kept as a hash table that is rebuilt as it grows, removes every
+   other one, creates 100 more in their place, and checks with
+   open() that exactly the files that should be there are. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+/* Creates files PREFIX0 through PREFIX<CNT - 1>. */
+static void
+create_files (char prefix, int cnt)
+{
+  char name[16];
+  int i;
+
+  msg ("creating \"%c0\" through \"%c%d\"", prefix, prefix, cnt - 1);
+  quiet = true;
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "%c%d", prefix, i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+}
+
+/* Checks that file PREFIX<I> exists if EXISTS is true, and that
+   it does not otherwise. */
+static void
+check_file_exists (char prefix, int i, bool exists)
+{
+  char name[16];
+  int fd;
+
+  snprintf (name, sizeof name, "%c%d", prefix, i);
+  fd = open (name);
+  if (exists && fd < 2)
+    fail ("open \"%s\" failed", name);
+  if (!exists && fd != -1)
+    fail ("open \"%s\" succeeded after remove", name);
+  if (fd > 1)
+    close (fd);
+}
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  create_files ('f', FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    check_file_exists ('f', i, true);
+
+  msg ("removing odd-numbered files");
+  quiet = true;
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  create_files ('g', FILE_CNT / 2);
+
+  msg ("checking files");
+  for (i = 0; i < FILE_CNT; i++)
+    check_file_exists ('f', i, i % 2 == 0);
+  for (i = 0; i < FILE_CNT / 2; i++)
+    check_file_exists ('g', i, true);
+}
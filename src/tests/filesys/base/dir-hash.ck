@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-hash) begin
+(dir-hash) creating "f0" through "f199"
+(dir-hash) removing odd-numbered files
+(dir-hash) creating "g0" through "g99"
+(dir-hash) checking files
+(dir-hash) end
+EOF
+pass;
@@ -0,0 +1,80 @@
+/* Fragments the free space on disk by growing two files in turn
+   until the disk is full and removing one of them, then writes a
+   file that needs many more extents than fit into its inode.
+   Checks its contents, and that removing it gives back every
+   sector it took, including those reserved for appends. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 512
+
+/* Enough blocks for about 48 extents of 16 sectors. */
+#define DATA_BLOCKS 768
+
+static char block[BLOCK_SIZE];
+static char buf[DATA_BLOCKS * BLOCK_SIZE];
+
+/* Returns the number of blocks that can be written to a new file
+   before the disk is full, then removes the file. */
+static size_t
+free_blocks (void)
+{
+  size_t cnt = 0;
+  int fd;
+
+  CHECK (create ("filler", 0), "create \"filler\"");
+  CHECK ((fd = open ("filler")) > 1, "open \"filler\"");
+  while (write (fd, block, sizeof block) == sizeof block)
+    cnt++;
+  msg ("close \"filler\"");
+  close (fd);
+  CHECK (remove ("filler"), "remove \"filler\"");
+
+  return cnt;
+}
+
+void
+test_main (void) 
+{
+  size_t before, after;
+  int a, b, c;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((a = open ("a")) > 1, "open \"a\"");
+  CHECK ((b = open ("b")) > 1, "open \"b\"");
+  msg ("write \"a\" and \"b\" in turn until the disk is full");
+  while (write (a, block, sizeof block) == sizeof block
+         && write (b, block, sizeof block) == sizeof block)
+    continue;
+  msg ("close \"a\"");
+  close (a);
+  msg ("close \"b\"");
+  close (b);
+  CHECK (remove ("b"), "remove \"b\"");
+
+  before = free_blocks ();
+  if (before < DATA_BLOCKS)
+    fail ("only %zu blocks free, expected at least %d",
+          before, DATA_BLOCKS);
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("c", 0), "create \"c\"");
+  CHECK ((c = open ("c")) > 1, "open \"c\"");
+  CHECK (write (c, buf, sizeof buf) == sizeof buf, "write \"c\"");
+  msg ("close \"c\"");
+  close (c);
+  check_file ("c", buf, sizeof buf);
+  CHECK (remove ("c"), "remove \"c\"");
+
+  after = free_blocks ();
+  if (after != before)
+    fail ("%zu blocks free after removing \"c\", expected %zu",
+          after, before);
+
+  CHECK (remove ("a"), "remove \"a\"");
+}
@@ -0,0 +1,34 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-extents) begin
+(grow-extents) create "a"
+(grow-extents) create "b"
+(grow-extents) open "a"
+(grow-extents) open "b"
+(grow-extents) write "a" and "b" in turn until the disk is full
+(grow-extents) close "a"
+(grow-extents) close "b"
+(grow-extents) remove "b"
+(grow-extents) create "filler"
+(grow-extents) open "filler"
+(grow-extents) close "filler"
+(grow-extents) remove "filler"
+(grow-extents) create "c"
+(grow-extents) open "c"
+(grow-extents) write "c"
+(grow-extents) close "c"
+(grow-extents) open "c" for verification
+(grow-extents) verified contents of "c"
+(grow-extents) close "c"
+(grow-extents) remove "c"
+(grow-extents) create "filler"
+(grow-extents) open "filler"
+(grow-extents) close "filler"
+(grow-extents) remove "filler"
+(grow-extents) remove "a"
+(grow-extents) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => [("a" x 512) . ("\0" x 9735) . ("b" x 100)
+			       . ("\0" x 9621) . ("c" x 512)]});
+pass;
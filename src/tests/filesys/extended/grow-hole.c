@@ -0,0 +1,42 @@
+/* Grows a file by writing its first and last blocks, leaving a
+   hole in between, then writes a few bytes into the middle of the
+   hole and checks that the rest of it reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 512
+#define BLOCK_CNT 40
+#define MID_OFS (BLOCK_CNT / 2 * BLOCK_SIZE + 7)
+#define MID_SIZE 100
+
+static char buf[BLOCK_CNT * BLOCK_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd;
+
+  memset (buf, 'a', BLOCK_SIZE);
+  memset (buf + MID_OFS, 'b', MID_SIZE);
+  memset (buf + sizeof buf - BLOCK_SIZE, 'c', BLOCK_SIZE);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, BLOCK_SIZE) == BLOCK_SIZE,
+         "write first block of \"%s\"", file_name);
+  seek (fd, sizeof buf - BLOCK_SIZE);
+  CHECK (write (fd, buf + sizeof buf - BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE,
+         "write last block of \"%s\"", file_name);
+  CHECK (filesize (fd) == sizeof buf, "filesize \"%s\"", file_name);
+  seek (fd, MID_OFS);
+  CHECK (write (fd, buf + MID_OFS, MID_SIZE) == MID_SIZE,
+         "write into hole of \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, sizeof buf);
+}
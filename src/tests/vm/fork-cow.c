@@ -0,0 +1,43 @@
+/* Forks a child that modifies a large buffer, and verifies that
+   the parent's copy of the buffer is left unchanged while the
+   child sees its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  msg ("initialize");
+  memset (buf, 0x5a, sizeof buf);
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Child: overwrite every page, then check the result. */
+      for (i = 0; i < SIZE; i += 4096)
+        memset (buf + i, 0xa5, 4096);
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != (char) 0xa5)
+          exit (1);
+      exit (81);
+    }
+
+  if (child < 0)
+    fail ("fork failed");
+  CHECK (wait (child) == 81, "wait for child");
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0x5a)
+      fail ("byte %zu != 0x5a", i);
+}
@@ -0,0 +1,41 @@
+/* Touches the pages of a large buffer and checks that memstat()
+   counts them as resident, then forks a child that checks that
+   it shares its pages with the parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 64
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  pid_t child;
+
+  CHECK (memstat (&before), "memstat");
+  memset (buf, 0x5a, sizeof buf);
+  CHECK (memstat (&after), "memstat after touching %d pages", PAGES);
+  if (after.resident < before.resident + PAGES)
+    fail ("%u pages resident, expected at least %u",
+          after.resident, before.resident + PAGES);
+
+  child = fork ();
+  if (child == 0)
+    {
+      struct memstat ms;
+
+      /* Child: everything resident is still the parent's. */
+      if (!memstat (&ms) || ms.shared < PAGES || ms.shared > ms.resident)
+        exit (1);
+      exit (81);
+    }
+
+  if (child < 0)
+    fail ("fork failed");
+  CHECK (wait (child) == 81, "wait for child");
+}
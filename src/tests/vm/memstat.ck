@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memstat) begin
+(memstat) memstat
+(memstat) memstat after touching 64 pages
+memstat: exit(81)
+(memstat) wait for child
+(memstat) end
+EOF
+pass;
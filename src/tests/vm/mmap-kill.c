@@ -0,0 +1,49 @@
+/* Maps a file, writes to it through the mapping and unmaps it,
+   checking that munmap() writes the data back.  Then forks a
+   child that maps the file again, overwrites it, and is killed by
+   an exception instead of calling exit().  The child's writes must
+   reach the file all the same. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+static char overwrite[sizeof sample];
+
+void
+test_main (void)
+{
+  mapid_t map;
+  pid_t child;
+  int handle;
+
+  CHECK (create ("sample.txt", sizeof sample), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, sizeof sample);
+  msg ("munmap \"sample.txt\"");
+  munmap (map);
+  check_file ("sample.txt", sample, sizeof sample);
+
+  memset (overwrite, 'x', sizeof overwrite);
+  child = fork ();
+  if (child == 0)
+    {
+      if (mmap (handle, ACTUAL) == MAP_FAILED)
+        exit (1);
+      memcpy (ACTUAL, overwrite, sizeof overwrite);
+
+      /* Breakpoint exception, which kills the process. */
+      asm volatile ("int $3");
+      exit (2);
+    }
+
+  CHECK (child > 0, "fork");
+  msg ("wait for child");
+  wait (child);
+  check_file ("sample.txt", overwrite, sizeof overwrite);
+}
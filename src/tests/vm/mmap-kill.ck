@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The child is killed by a breakpoint exception.
+@output = grep (!/: dying due to interrupt 0x03 \(.*\).$/
+		&& !/^Interrupt 0x03 \(.*\) at eip=/
+		&& !/^ cr2=.* error=.*/
+		&& !/^ eax=.* ebx=.* ecx=.* edx=.*/
+		&& !/^ esi=.* edi=.* esp=.* ebp=.*/
+		&& !/^ cs=.* ds=.* es=.* ss=.*/, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(mmap-kill) begin
+(mmap-kill) create "sample.txt"
+(mmap-kill) open "sample.txt"
+(mmap-kill) mmap "sample.txt"
+(mmap-kill) munmap "sample.txt"
+(mmap-kill) open "sample.txt" for verification
+(mmap-kill) verified contents of "sample.txt"
+(mmap-kill) close "sample.txt"
+(mmap-kill) fork
+(mmap-kill) wait for child
+(mmap-kill) open "sample.txt" for verification
+(mmap-kill) verified contents of "sample.txt"
+(mmap-kill) close "sample.txt"
+(mmap-kill) end
+EOF
+pass;
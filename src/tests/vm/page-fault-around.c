@@ -0,0 +1,45 @@
+/* Reads the pages of a large buffer of zeros and checks that
+   fault-around maps the pages next to each faulting one, so that
+   this takes fewer faults than there are pages.  Then writes the
+   buffer and checks that the writes went to pages of its own, not
+   to the frame of zeros the pages were mapped to. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 64
+
+static char buf[PAGES * 4096];
+static char zeros[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  size_t i;
+  int sum = 0;
+
+  CHECK (vmstat (VM_MINOR_FAULT, &before), "vmstat");
+  for (i = 0; i < sizeof buf; i += 4096)
+    sum += ((volatile char *) buf)[i];
+  CHECK (vmstat (VM_MINOR_FAULT, &after), "vmstat after reading %d pages",
+         PAGES);
+  if (sum != 0)
+    fail ("buffer is not zeroed");
+  if (after.count - before.count >= PAGES / 2)
+    fail ("%llu minor faults for %d pages",
+          after.count - before.count, PAGES);
+
+  msg ("write pass");
+  memset (buf, 0x5a, sizeof buf);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0x5a)
+      fail ("byte %zu != 0x5a", i);
+
+  msg ("read pass");
+  for (i = 0; i < sizeof zeros; i++)
+    if (zeros[i] != 0)
+      fail ("byte %zu of other buffer != 0", i);
+}
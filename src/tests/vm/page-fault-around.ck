@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fault-around) begin
+(page-fault-around) vmstat
+(page-fault-around) vmstat after reading 64 pages
+(page-fault-around) write pass
+(page-fault-around) read pass
+(page-fault-around) end
+EOF
+pass;
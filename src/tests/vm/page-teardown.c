@@ -0,0 +1,82 @@
+/* Forks children that each overwrite a large buffer shared with
+   the parent, two at a time, so that one of them exits while the
+   other is evicting pages.  Checks that each child sees its own
+   data and that the parent's buffer is intact after the children
+   have been torn down. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define ROUNDS 4
+
+static char buf[SIZE];
+
+/* Value of the bytes of page PAGE of BUF for process ID. */
+static char
+pattern (size_t page, int id)
+{
+  return page * 7 + id;
+}
+
+/* Fills BUF with the pattern of ID, page by page. */
+static void
+fill (int id)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i += 4096)
+    memset (buf + i, pattern (i / 4096, id), 4096);
+}
+
+/* Returns true if BUF holds the pattern of ID. */
+static bool
+verify (int id)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != pattern (i / 4096, id))
+      return false;
+  return true;
+}
+
+/* Forks a child that fills and checks BUF, and exits with ID. */
+static pid_t
+spawn (int id)
+{
+  pid_t child = fork ();
+
+  if (child == 0)
+    {
+      fill (id);
+      exit (verify (id) ? id : 1);
+    }
+  if (child < 0)
+    fail ("fork failed");
+  return child;
+}
+
+void
+test_main (void)
+{
+  int round;
+
+  msg ("initialize");
+  fill (0);
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      int id = 10 + 2 * round;
+      pid_t a = spawn (id);
+      pid_t b = spawn (id + 1);
+
+      CHECK (wait (a) == id && wait (b) == id + 1, "round %d", round);
+    }
+
+  msg ("read pass");
+  if (!verify (0))
+    fail ("parent's buffer changed");
+}
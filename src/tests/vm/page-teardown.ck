@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-teardown) begin
+(page-teardown) initialize
+(page-teardown) round 0
+(page-teardown) round 1
+(page-teardown) round 2
+(page-teardown) round 3
+(page-teardown) read pass
+(page-teardown) end
+EOF
+pass;
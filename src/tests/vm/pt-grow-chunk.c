@@ -0,0 +1,47 @@
+/* Grows the stack a page at a time by deep recursion, across
+   several of the chunks the kernel grows the stack by at once, and
+   checks that each frame keeps its contents and that the stack
+   grew fewer times than it has pages. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH 24
+
+/* The frame of each level, so that the compiler cannot drop the
+   writes to it. */
+static char *frames[DEPTH];
+
+static void
+recurse (int depth)
+{
+  char frame[4000];
+  size_t i;
+
+  frames[depth] = frame;
+  memset (frame, depth, sizeof frame);
+  if (depth + 1 < DEPTH)
+    recurse (depth + 1);
+
+  for (i = 0; i < sizeof frame; i++)
+    if (frames[depth][i] != depth)
+      fail ("byte %zu of frame %d is %d", i, depth, frames[depth][i]);
+}
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+
+  CHECK (vmstat (VM_STACK_GROWTH, &before), "vmstat");
+  recurse (0);
+  CHECK (vmstat (VM_STACK_GROWTH, &after), "vmstat after recursing %d deep",
+         DEPTH);
+  if (after.count == before.count)
+    fail ("stack did not grow");
+  if (after.count - before.count > DEPTH / 2)
+    fail ("stack grew %llu times for %d pages",
+          after.count - before.count, DEPTH);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pt-grow-chunk) begin
+(pt-grow-chunk) vmstat
+(pt-grow-chunk) vmstat after recursing 24 deep
+(pt-grow-chunk) end
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Runs with a resident set limit of 32 pages and writes a buffer
+   four times that size, so that the process has to evict its own
+   pages to make room for new ones, then checks that every page
+   still holds what was written to it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 128
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct memstat ms;
+  size_t i;
+
+  CHECK (memstat (&ms), "memstat");
+  if (ms.rss_limit != 32)
+    fail ("resident set limit is %u, expected 32", ms.rss_limit);
+
+  msg ("write %d pages", PAGES);
+  for (i = 0; i < PAGES; i++)
+    memset (buf + i * 4096, i, 4096);
+
+  msg ("check %d pages", PAGES);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != (char) (i / 4096))
+      fail ("byte %zu is %d, expected %d", i, buf[i], (char) (i / 4096));
+
+  CHECK (memstat (&ms), "memstat after writing");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rss-limit) begin
+(rss-limit) memstat
+(rss-limit) write 128 pages
+(rss-limit) check 128 pages
+(rss-limit) memstat after writing
+(rss-limit) end
+rss-limit: exit(0)
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Writes to the pages of a large buffer of zeros and checks that
+   vmstat() counts a minor fault for each of them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 32
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  unsigned long long sum;
+  int i;
+
+  CHECK (vmstat (VM_MINOR_FAULT, &before), "vmstat");
+  memset (buf, 0x5a, sizeof buf);
+  CHECK (vmstat (VM_MINOR_FAULT, &after), "vmstat after touching %d pages",
+         PAGES);
+  if (after.count < before.count + PAGES)
+    fail ("%llu minor faults, expected at least %llu",
+          after.count, before.count + PAGES);
+
+  sum = 0;
+  for (i = 0; i < VMSTAT_BUCKETS; i++)
+    sum += after.buckets[i];
+  if (sum != after.count)
+    fail ("histogram holds %llu faults, not %llu", sum, after.count);
+  if (after.max > after.total)
+    fail ("largest value exceeds total");
+
+  CHECK (!vmstat (VM_EVENT_CNT, &after), "vmstat of bad event");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vmstat) begin
+(vmstat) vmstat
+(vmstat) vmstat after touching 32 pages
+(vmstat) vmstat of bad event
+(vmstat) end
+vmstat: exit(0)
+EOF
+pass;
@@ -13,6 +13,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -31,10 +32,13 @@
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/stats.h"
 #include "vm/swap.h"
 #endif 
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -55,6 +59,7 @@ bool power_off_when_done;
 
 static void ram_init (void);
 static void paging_init (void);
+static uint32_t cpu_features (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -152,11 +157,29 @@ ram_init (void)
   ram_pages = *(uint32_t *) ptov (LOADER_RAM_PGS);
 }
 
+/* CR4 bits. */
+#define CR4_PSE 0x00000010      /* Page Size Extensions. */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+
+/* CPUID feature bits, in EDX for EAX=1. */
+#define CPUID_PSE 0x00000008    /* Page Size Extensions. */
+#define CPUID_PGE 0x00002000    /* Page Global Enable. */
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points base_page_dir to the page
    directory it creates.
 
+   If the CPU supports them, each whole 4 MB of RAM is mapped with
+   a single 4 MB page, which needs no page table and takes a
+   single TLB entry.  The 4 MB that hold the kernel's code are
+   mapped page by page, to keep the code read-only, as is any
+   RAM beyond the last whole 4 MB.
+
+   The kernel mapping is the same in every page directory, so it
+   is made global if the CPU allows.  Its TLB entries then survive
+   switches between processes' page directories.
+
    At the time this function is called, the active page table
    (set up by loader.S) only maps the first 4 MB of RAM, so we
    should not try to use extravagant amounts of memory.
@@ -165,26 +188,46 @@ static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
-  size_t page;
+  size_t page, i;
+  uint32_t features = cpu_features ();
+  bool pse = (features & CPUID_PSE) != 0;
+  uint32_t global = features & CPUID_PGE ? PTE_G : 0;
   extern char _start, _end_kernel_text;
 
+  if (pse)
+    asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                  : : "i" (CR4_PSE) : "eax");
+
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-  pt = NULL;
-  for (page = 0; page < ram_pages; page++) 
+  for (page = 0; page < ram_pages; page += PTSPAN / PGSIZE)
     {
       uintptr_t paddr = page * PGSIZE;
       char *vaddr = ptov (paddr);
       size_t pde_idx = pd_no (vaddr);
-      size_t pte_idx = pt_no (vaddr);
-      bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
+      size_t page_cnt = ram_pages - page;
+      bool has_kernel_text = vaddr < &_end_kernel_text
+                             && &_start < vaddr + PTSPAN;
 
-      if (pd[pde_idx] == 0)
+      if (page_cnt >= PTSPAN / PGSIZE)
         {
-          pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-          pd[pde_idx] = pde_create (pt);
+          page_cnt = PTSPAN / PGSIZE;
+          if (pse && !has_kernel_text)
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true) | global;
+              continue;
+            }
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      pd[pde_idx] = pde_create (pt);
+      for (i = 0; i < page_cnt; i++)
+        {
+          char *pvaddr = vaddr + i * PGSIZE;
+          bool in_kernel_text = &_start <= pvaddr
+                                && pvaddr < &_end_kernel_text;
+
+          pt[i] = pte_create_kernel (pvaddr, !in_kernel_text) | global;
+        }
     }
 
   /* Store the physical address of the page directory into CR3
@@ -193,6 +236,31 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
+
+  /* Global pages may only be enabled once paging is, see
+     [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+  if (global)
+    asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                  : : "i" (CR4_PGE) : "eax");
+}
+
+/* Returns the CPU's feature bits, see CPUID_*, or 0 if it lacks
+   the CPUID instruction.  Such CPUs do not let FLAG_ID be
+   changed. */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t old_flags, new_flags;
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("pushfl; popl %0; movl %0, %1; xorl %2, %1; "
+                "pushl %1; popfl; pushfl; popl %1; pushl %0; popfl"
+                : "=&r" (old_flags), "=&r" (new_flags) : "i" (FLAG_ID));
+  if (((old_flags ^ new_flags) & FLAG_ID) == 0)
+    return 0;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -256,6 +324,25 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-cs"))
+        clock_spread = atoi (value);
+      else if (!strcmp (name, "-cb"))
+        clock_budget = atoi (value);
+      else if (!strcmp (name, "-fa"))
+        fault_around = atoi (value);
+      else if (!strcmp (name, "-sm"))
+        stack_max = (size_t) atoi (value) * 1024;
+      else if (!strcmp (name, "-zs"))
+        zcache_limit = (size_t) atoi (value) * 1024;
+      else if (!strcmp (name, "-rl"))
+        rss_limit = atoi (value);
+      else if (!strcmp (name, "-rp"))
+        {
+          if (value == NULL || !frame_set_policy (value))
+            PANIC ("unknown replacement policy `%s'", value);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -360,6 +447,15 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -cs=COUNT          Run the front clock hand COUNT frames ahead.\n"
+          "  -cb=COUNT          Scan at most COUNT frames per eviction.\n"
+          "  -fa=COUNT          Map up to COUNT resident pages per page fault.\n"
+          "  -sm=KB             Let user stacks grow up to KB kB.\n"
+          "  -zs=KB             Keep up to KB kB of compressed swap in memory.\n"
+          "  -rl=COUNT          Limit each process to COUNT resident pages.\n"
+          "  -rp=POLICY         Use page replacement POLICY (clock, wsclock).\n"
 #endif
           );
   power_off ();
@@ -398,10 +494,16 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
+  cache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+  vm_stats_print ();
+#endif
 }
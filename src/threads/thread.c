@@ -186,7 +186,12 @@ thread_tick (void)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      user_ticks++;
+#ifdef VM
+      t->vm_ticks++;
+#endif
+    }
 #endif
   else
     kernel_ticks++;
@@ -756,6 +761,17 @@ init_thread (struct thread *t, const char *name, int priority)
   list_init (&t->children);
   list_init (&t->files);
 #endif
+#ifdef VM
+  list_init (&t->mappings);
+  t->vm_ticks = 0;
+  list_init (&t->vmas);
+  t->stack_vma = NULL;
+  t->user_esp = NULL;
+  t->vm_exiting = false;
+  t->vm_resident = 0;
+  t->vm_shared = 0;
+  t->vm_swapped = 0;
+#endif
 
   t->magic = THREAD_MAGIC;
   list_push_back (&all_list, &t->allelem);
@@ -125,6 +125,15 @@ struct thread
 
 #ifdef VM
     struct hash page_table;             /* Supplemental page table for process */
+    struct list mappings;               /* A list of memory mappings. */
+    int64_t vm_ticks;                   /* Ticks run, the virtual time. */
+    struct list vmas;                   /* Virtual memory areas. */
+    struct vma *stack_vma;              /* Area of the user stack. */
+    void *user_esp;                     /* User esp on syscall entry. */
+    bool vm_exiting;                    /* Releasing all pages. */
+    size_t vm_resident;                 /* Pages in frames. */
+    size_t vm_shared;                   /* Resident pages sharing frames. */
+    size_t vm_swapped;                  /* Pages in swap. */
 #endif
 
     /* Owned by thread.c. */
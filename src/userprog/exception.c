@@ -16,10 +16,6 @@ static long long page_fault_cnt;
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
-#ifdef VM
-bool check_stack (struct intr_frame *f, void * fault_addr);
-#endif
-
 /* Registers handlers for interrupts that can be caused by user
    programs.
 
@@ -160,8 +156,18 @@ page_fault (struct intr_frame *f)
 #ifdef VM
   if (not_present)
     {
-      if (page_load (fault_addr)) return;
-      if (check_stack (f, fault_addr)) return;
+      /* A fault in the kernel, e.g. while copying a system call's
+         buffer, happens with the user stack pointer saved on
+         entry to the system call. */
+      void *esp = user ? f->esp : thread_current ()->user_esp;
+
+      if (page_load (fault_addr, write)) return;
+      if (page_grow_stack (fault_addr, esp)) return;
+    }
+  else if (write)
+    {
+      /* A write to a page shared with a forked process. */
+      if (page_copy_on_write (fault_addr)) return;
     }
 #endif
 
@@ -181,30 +187,3 @@ page_fault (struct intr_frame *f)
           user ? "user" : "kernel");
   kill (f);
 }
-
-#ifdef VM
-/* Check to see if we need to extend the stack.  If so, add a page to our
-   supplementary page table and load the page into memory */
-bool
-check_stack (struct intr_frame *f, void * fault_addr)
-{
-  /* Get the stack pointer */
-  void * esp = f->esp;
-
-  /* PUSH and PUSHA fault 4 and 32 below the stack pointer.  
-     Any faults above the stack pointer should extend the stack as well. */
-  if (esp == fault_addr || (esp - 4) == fault_addr 
-      || (esp - 32) == fault_addr 
-      || (fault_addr > esp && fault_addr < PHYS_BASE))
-    {
-      /* Add an entry to our supplementary page table */
-      struct page *p = page_alloc (fault_addr, true);
-      if (p != NULL)
-        return true;
-
-      kill (f);
-    }
-
-  return false;
-}
-#endif
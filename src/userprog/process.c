@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -32,7 +33,21 @@ struct program_info {
   bool load_success;            /* Whether it loaded successfully. */
 };
 
+#ifdef VM
+/* The user context of a process calling fork().  This is only
+   used to pass data between process_fork() and start_fork(). */
+struct fork_info {
+  struct thread *parent;        /* Parent thread. */
+  struct intr_frame if_;        /* Parent's user registers. */
+  struct semaphore sema_fork;   /* Signal when copying is done. */
+  bool fork_success;            /* Whether it copied successfully. */
+};
+
+static thread_func start_fork NO_RETURN;
+#endif
+
 static thread_func start_process NO_RETURN;
+static void add_child (struct process_status *ps, struct thread *parent);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 static bool push_args (char *args, void **esp);
 
@@ -138,14 +153,7 @@ start_process (void *_pinfo)
     }
     else 
     {
-      ps->t = t;
-      ps->tid = t->tid;
-      ps->parent = pinfo->parent;
-      sema_init (&ps->sema_wait, 0);
-      list_push_back (&pinfo->parent->children, &ps->elem);
-      
-      t->ps = ps;
-
+      add_child (ps, pinfo->parent);
       sema_up (&pinfo->sema_load);
     }
 
@@ -159,6 +167,108 @@ start_process (void *_pinfo)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Creates a copy of the current process, which returns from the
+   system call with the user registers in IF_, except that it gets
+   0 as the result.  Memory is shared copy-on-write, see
+   page_table_fork().  Returns the new process's thread id, or
+   TID_ERROR if it cannot be created. */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct thread *t = thread_current ();
+  struct fork_info finfo;
+  tid_t tid;
+
+  finfo.parent = t;
+  finfo.if_ = *if_;
+  finfo.fork_success = false;
+  sema_init (&finfo.sema_fork, 0);
+
+  tid = thread_create (t->name, PRI_DEFAULT, start_fork, &finfo);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* Our pages must not change until they are copied. */
+  sema_down (&finfo.sema_fork);
+
+  if (!finfo.fork_success)
+    tid = TID_ERROR;
+
+  return tid;
+}
+
+/* A thread function that copies the parent's address space and
+   open files, and returns to user mode as the child. */
+static void
+start_fork (void *_finfo)
+{
+  struct fork_info *finfo = (struct fork_info *) _finfo;
+  struct thread *parent = finfo->parent;
+  struct process_status *ps = NULL;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = finfo->if_;
+  bool success;
+
+  /* The pages of the executable are read from our own copy of the
+     file, which stays open as long as the process. */
+  if (parent->exec != NULL)
+    {
+      lock_acquire (&file_lock);
+      t->exec = file_reopen (parent->exec);
+      if (t->exec != NULL)
+        file_deny_write (t->exec);
+      lock_release (&file_lock);
+    }
+
+  success = page_table_init (&t->page_table)
+            && (parent->exec == NULL || t->exec != NULL)
+            && (t->pagedir = pagedir_create ()) != NULL
+            && vma_table_fork (parent)
+            && page_table_fork (parent)
+            && syscall_copy_files (parent)
+            && (ps = malloc (sizeof (struct process_status))) != NULL;
+
+  finfo->fork_success = success;
+
+  /* If copying failed, quit. */
+  if (!success)
+    {
+      sema_up (&finfo->sema_fork);
+      thread_exit ();
+    }
+
+  add_child (ps, parent);
+  sema_up (&finfo->sema_fork);
+
+  process_activate ();
+
+  /* The child returns 0 from fork(). */
+  if_.eax = 0;
+
+  /* Start the user process by simulating a return from an
+     interrupt, see start_process(). */
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
+/* Records PS as the status of the current process, which is a
+   child of PARENT. */
+static void
+add_child (struct process_status *ps, struct thread *parent)
+{
+  struct thread *t = thread_current ();
+
+  ps->t = t;
+  ps->tid = t->tid;
+  ps->parent = parent;
+  sema_init (&ps->sema_wait, 0);
+  list_push_back (&parent->children, &ps->elem);
+
+  t->ps = ps;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -207,6 +317,12 @@ process_exit (void)
   struct thread *curr = thread_current ();
   uint32_t *pd;
 
+#ifdef VM
+  /* Write mapped files back before a waiting parent can look at
+     them. */
+  syscall_unmap_all ();
+#endif
+
   if (curr->ps != NULL) 
   {
     printf ("%s: exit(%d)\n", curr->name, curr->ps->exit_status);
@@ -230,6 +346,7 @@ process_exit (void)
 
 #ifdef VM
   page_table_destroy (&curr->page_table);
+  vma_table_destroy (&curr->vmas);
 #endif
   
   /* Allow writes to the exec file. */
@@ -265,8 +382,13 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  Kernel threads only use the
+     kernel mapping, which every page directory has, so they keep
+     whatever page directory is active.  That is never one that has
+     been destroyed: process_exit() activates the base page
+     directory first. */
+  if (t->pagedir != NULL)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -429,7 +551,14 @@ load (const char *file_name, void (**eip) (void), void **esp)
   process_activate ();
 
   /* Open executable file. */
+#ifdef VM
+  /* Segments are read in lazily, so they need a file that stays
+     open as long as the process.  start_process() has opened
+     one already, and process_exit() closes it. */
+  file = t->exec;
+#else
   file = filesys_open (file_name);
+#endif
   if (file == NULL) 
     {
       printf ("load: %s: open failed\n", file_name);
@@ -519,7 +648,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifndef VM
   file_close (file);
+#endif
   return success;
 }
 
@@ -594,6 +725,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Only record where the segment comes from.  Its pages are read
+     in by page_load() on the first access. */
+  return vma_create (upage, read_bytes + zero_bytes, writable, file, ofs,
+                     read_bytes, false) != NULL;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -603,21 +740,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-#ifdef VM
-      struct page *p = page_alloc (upage, writable);
-      if (p == NULL)
-        return false;
-
-      uint8_t *kpage = p->frame->kaddr;
-
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          page_free (p);
-          return false; 
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -637,7 +759,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
-#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -646,6 +767,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
     }
 
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -654,8 +776,12 @@ static bool
 setup_stack (void **esp) 
 {
 #ifdef VM
-  struct page *p = page_alloc (((uint8_t *) PHYS_BASE) - PGSIZE, true);
-  if (p == NULL)
+  struct thread *t = thread_current ();
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  /* The area grows down, see page_grow_stack(). */
+  t->stack_vma = vma_create (upage, PGSIZE, true, NULL, 0, 0, false);
+  if (t->stack_vma == NULL || !page_load (upage, true))
     return false;
 
   *esp = PHYS_BASE;
@@ -1,6 +1,7 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 
 struct process_status
@@ -14,6 +15,9 @@ struct process_status
   };
 
 tid_t process_execute (const char *file_name);
+#ifdef VM
+tid_t process_fork (const struct intr_frame *if_);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
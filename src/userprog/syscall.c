@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <round.h>
 #include <syscall-nr.h>
 #include "userprog/process.h"
 #include "threads/interrupt.h"
@@ -10,6 +11,11 @@
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "devices/input.h"
+#ifdef VM
+#include "vm/page.h"
+#include "vm/stats.h"
+#include "vm/vma.h"
+#endif
 
 /* Process identifier. */
 typedef int pid_t;
@@ -17,6 +23,10 @@ typedef int pid_t;
 /* File identifier. */
 typedef int fid_t;
 
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
 static void syscall_handler (struct intr_frame *);
 
 static void      sys_halt (void);
@@ -32,6 +42,13 @@ static int       sys_write (int fd, const void *buffer, unsigned size);
 static void      sys_seek (int fd, unsigned position);
 static unsigned  sys_tell (int fd);
 static void      sys_close (int fd);
+#ifdef VM
+static mapid_t   sys_mmap (int fd, void *addr);
+static void      sys_munmap (mapid_t mapid);
+static pid_t     sys_fork (struct intr_frame *f);
+static bool      sys_memstat (struct memstat *ms);
+static bool      sys_vmstat (int event, struct vmstat *vs);
+#endif
 
 struct user_file
   {
@@ -40,11 +57,32 @@ struct user_file
     struct list_elem thread_elem;      /* List elem for a thread's file list. */
   };
 
-static struct lock file_lock;
+struct lock file_lock;
 static struct list file_list;
 
 static fid_t allocate_fid (void);
 static struct user_file *file_by_fid (int fid);
+static int transfer (struct file *file, void *buffer, unsigned size,
+                     bool write);
+
+#ifdef VM
+/* Largest part of a user buffer that transfer() pins at once. */
+#define PIN_CHUNK (16 * PGSIZE)
+#endif
+
+#ifdef VM
+struct mapping
+  {
+    mapid_t mapid;                     /* Map region identifier. */
+    struct file *file;                 /* The mapped file. */
+    struct vma *vma;                   /* The mapped region. */
+    struct list_elem thread_elem;      /* List elem for a thread's mappings. */
+  };
+
+static mapid_t allocate_mapid (void);
+static struct mapping *mapping_by_mapid (mapid_t mapid);
+static void unmap (struct mapping *m);
+#endif
 
 /* Initialization of syscall handlers */
 void
@@ -66,6 +104,11 @@ syscall_handler (struct intr_frame *f)
   void *arg2 = (int *) f->esp + 2;
   void *arg3 = (int *) f->esp + 3;
 
+#ifdef VM
+  /* For stack growth on page faults in the kernel. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
   /* Check validate pointer. */
   if (!is_user_vaddr (syscall_nr) || !is_user_vaddr (arg1) ||
       !is_user_vaddr (arg2)       || !is_user_vaddr (arg3))
@@ -112,6 +155,23 @@ syscall_handler (struct intr_frame *f)
     case SYS_CLOSE:
       sys_close (*(int *) arg1);
       break;
+#ifdef VM
+    case SYS_MMAP:
+      ret = sys_mmap (*(int *) arg1, *(void **) arg2);
+      break;
+    case SYS_MUNMAP:
+      sys_munmap (*(mapid_t *) arg1);
+      break;
+    case SYS_FORK:
+      ret = sys_fork (f);
+      break;
+    case SYS_MEMSTAT:
+      ret = sys_memstat (*(struct memstat **) arg1);
+      break;
+    case SYS_VMSTAT:
+      ret = sys_vmstat (*(int *) arg1, *(struct vmstat **) arg2);
+      break;
+#endif
     default:
       printf (" (%s) system call! (%d)\n", thread_name (), *syscall_nr);
       sys_exit (-1);
@@ -311,11 +371,7 @@ sys_read (int fd, void *buffer, unsigned size)
       if (f == NULL)
         ret = -1;
       else
-        {
-          lock_acquire (&file_lock);
-          ret = file_read (f->file, buffer, size);
-          lock_release (&file_lock);
-        }
+        ret = transfer (f->file, buffer, size, false);
     }
 
   return ret;
@@ -347,11 +403,7 @@ sys_write (int fd, const void *buffer, unsigned size)
       if (f == NULL)
         ret = -1;
       else
-        {
-          lock_acquire (&file_lock);
-          ret = file_write (f->file, buffer, size);
-          lock_release (&file_lock);
-        }
+        ret = transfer (f->file, (void *) buffer, size, true);
     }
   return ret;
 }
@@ -419,6 +471,168 @@ sys_close (int fd)
   lock_release (&file_lock);
 }
 
+#ifdef VM
+/* Map a file into memory. */
+static mapid_t
+sys_mmap (int fd, void *addr)
+{
+  struct user_file *f;
+  struct mapping *m;
+  off_t length;
+
+#if PRINT_DEBUG
+  printf ("[SYSCALL] SYS_MMAP: fd: %d, addr: %p\n", fd, addr);
+#endif
+
+  f = file_by_fid (fd);
+  if (f == NULL || addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+
+  lock_acquire (&file_lock);
+  length = file_length (f->file);
+  lock_release (&file_lock);
+  if (length == 0)
+    return MAP_FAILED;
+
+  m = (struct mapping *) malloc (sizeof (struct mapping));
+  if (m == NULL)
+    return MAP_FAILED;
+
+  /* The region reserved for the stack is off limits, even where
+     the stack has not grown yet.  vma_create() checks the rest. */
+  if (!is_user_vaddr (addr)
+      || (uint8_t *) addr + ROUND_UP (length, PGSIZE)
+         > (uint8_t *) PHYS_BASE - stack_max)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+
+  /* The mapping stays valid after the file is closed. */
+  lock_acquire (&file_lock);
+  m->file = file_reopen (f->file);
+  lock_release (&file_lock);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+
+  /* Pages are read in on the first access. */
+  m->vma = vma_create (addr, length, true, m->file, 0, length, true);
+  if (m->vma == NULL)
+    {
+      lock_acquire (&file_lock);
+      file_close (m->file);
+      lock_release (&file_lock);
+      free (m);
+      return MAP_FAILED;
+    }
+
+  m->mapid = allocate_mapid ();
+  list_push_back (&thread_current ()->mappings, &m->thread_elem);
+
+  return m->mapid;
+}
+
+/* Remove a memory mapping. */
+static void
+sys_munmap (mapid_t mapid)
+{
+  struct mapping *m;
+
+#if PRINT_DEBUG
+  printf ("[SYSCALL] SYS_MUNMAP: mapid: %d\n", mapid);
+#endif
+
+  m = mapping_by_mapid (mapid);
+  if (m != NULL)
+    unmap (m);
+}
+
+/* Create a copy of the current process. */
+static pid_t
+sys_fork (struct intr_frame *f)
+{
+#if PRINT_DEBUG
+  printf ("[SYSCALL] SYS_FORK\n");
+#endif
+
+  return process_fork (f);
+}
+
+/* Reports the memory usage of the current process. */
+static bool
+sys_memstat (struct memstat *ms)
+{
+#if PRINT_DEBUG
+  printf ("[SYSCALL] SYS_MEMSTAT: ms: %p\n", ms);
+#endif
+
+  if (!page_memstat (ms))
+    sys_exit (-1);
+
+  return true;
+}
+
+/* Reports the statistics of virtual memory EVENT.  Returns false
+   if there is no such event. */
+static bool
+sys_vmstat (int event, struct vmstat *vs)
+{
+  bool success;
+
+#if PRINT_DEBUG
+  printf ("[SYSCALL] SYS_VMSTAT: event: %d, vs: %p\n", event, vs);
+#endif
+
+  if (!page_pin_buffer (vs, sizeof *vs, true))
+    sys_exit (-1);
+  success = vm_stats_get (event, vs);
+  page_unpin_buffer (vs, sizeof *vs);
+
+  return success;
+}
+#endif
+
+/* Gives the current thread its own copy of each file PARENT has
+   open, with the same fid and at the same position.  Used by
+   fork().  Returns false if memory allocation fails. */
+bool
+syscall_copy_files (struct thread *parent)
+{
+  struct list_elem *e;
+  bool success = true;
+
+  lock_acquire (&file_lock);
+  for (e = list_begin (&parent->files); e != list_end (&parent->files);
+       e = list_next (e))
+    {
+      struct user_file *pf = list_entry (e, struct user_file, thread_elem);
+      struct user_file *f = malloc (sizeof (struct user_file));
+
+      if (f == NULL)
+        {
+          success = false;
+          break;
+        }
+
+      f->file = file_reopen (pf->file);
+      if (f->file == NULL)
+        {
+          free (f);
+          success = false;
+          break;
+        }
+      file_seek (f->file, file_tell (pf->file));
+      f->fid = pf->fid;
+      list_push_back (&thread_current ()->files, &f->thread_elem);
+    }
+  lock_release (&file_lock);
+
+  return success;
+}
+
 /* Extern function for sys_exit */
 void 
 sys_t_exit (int status)
@@ -426,6 +640,52 @@ sys_t_exit (int status)
   sys_exit (status);
 }
 
+/* Writes the SIZE bytes at BUFFER to FILE if WRITE is true, or
+   reads SIZE bytes from FILE into BUFFER otherwise, and returns
+   the number of bytes transferred.  Under VM, the buffer is pinned
+   a chunk at a time, so that accessing it does not fault while
+   the file system lock is held.  If a chunk cannot be pinned, the
+   buffer is invalid and the process is killed. */
+static int
+transfer (struct file *file, void *buffer, unsigned size, bool write)
+{
+#ifdef VM
+  uint8_t *buf = buffer;
+  int ret = 0;
+
+  while (size > 0)
+    {
+      unsigned chunk = size < PIN_CHUNK ? size : PIN_CHUNK;
+      off_t cnt;
+
+      if (!page_pin_buffer (buf, chunk, !write))
+        sys_exit (-1);
+
+      lock_acquire (&file_lock);
+      cnt = write ? file_write (file, buf, chunk) : file_read (file, buf, chunk);
+      lock_release (&file_lock);
+
+      page_unpin_buffer (buf, chunk);
+
+      ret += cnt;
+      if (cnt < (off_t) chunk)
+        break;
+      buf += chunk;
+      size -= chunk;
+    }
+
+  return ret;
+#else
+  int ret;
+
+  lock_acquire (&file_lock);
+  ret = write ? file_write (file, buffer, size) : file_read (file, buffer, size);
+  lock_release (&file_lock);
+
+  return ret;
+#endif
+}
+
 /* Allocate a new fid for a file */
 static fid_t
 allocate_fid (void)
@@ -458,3 +718,65 @@ file_by_fid (int fid)
 
   return NULL;
 }
+
+#ifdef VM
+/* Allocate a new mapid for a memory mapping */
+static mapid_t
+allocate_mapid (void)
+{
+  static mapid_t next_mapid = 0;
+  mapid_t ret_mapid;
+
+  lock_acquire (&file_lock);
+  ret_mapid = next_mapid++;
+  lock_release (&file_lock);
+
+  return ret_mapid;
+}
+
+/* Returns the mapping with the given mapid from the current
+   thread's mappings */
+static struct mapping *
+mapping_by_mapid (mapid_t mapid)
+{
+  struct list_elem *e;
+  struct thread *t;
+
+  t = thread_current ();
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, thread_elem);
+      if (m->mapid == mapid)
+        return m;
+    }
+
+  return NULL;
+}
+
+/* Writes back and removes all memory mappings of the current
+   thread, which is exiting, however it exits. */
+void
+syscall_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_begin (&t->mappings), struct mapping,
+                       thread_elem));
+}
+
+/* Removes mapping M of the current thread.  Modified pages are
+   written back to the file. */
+static void
+unmap (struct mapping *m)
+{
+  vma_destroy (m->vma);
+
+  lock_acquire (&file_lock);
+  list_remove (&m->thread_elem);
+  file_close (m->file);
+  free (m);
+  lock_release (&file_lock);
+}
+#endif
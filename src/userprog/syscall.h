@@ -1,7 +1,18 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Serializes file system accesses. */
+extern struct lock file_lock;
+
 void syscall_init (void);
 void sys_t_exit (int status);
+bool syscall_copy_files (struct thread *parent);
+#ifdef VM
+void syscall_unmap_all (void);
+#endif
 
 #endif /* userprog/syscall.h */
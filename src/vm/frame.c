@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <list.h>
+#include <stdio.h>
 #include <string.h>
 #include <user/syscall.h>
 #include "userprog/pagedir.h"
@@ -9,15 +10,113 @@
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "vm/page.h"
+#include "vm/stats.h"
+#include "vm/swap.h"
 
 static struct list frame_table;       /* Frame table. */
+static size_t frame_cnt;              /* Number of frames in the table. */
 static struct lock frame_lock;        /* Frame lock. */
-static struct list_elem *clock_hand;  /* The hand of the clock. */
+static struct condition frame_cond;   /* Signaled when an evictor gives
+                                         a frame back or evicts a page
+                                         from it. */
 
+/* Two-handed clock.  The front hand runs ahead of the back hand
+   and clears the accessed bits of the frames it passes.  The back
+   hand picks frames that have not been accessed since. */
+static struct list_elem *clock_hand;  /* The back hand of the clock. */
+static struct list_elem *front_hand;  /* The front hand of the clock. */
+static size_t hand_gap;               /* Frames between the hands. */
+
+/* -cs: Number of frames the front hand runs ahead. */
+size_t clock_spread = 32;
+
+/* -cb: Maximum number of frames scanned to find a victim. */
+size_t clock_budget = 256;
+
+/* -rl: Most pages a process may have resident, or 0 for no limit.
+   A process at its limit replaces its own pages. */
+size_t rss_limit = 0;
+
+/* A page replacement policy.  The clock scan asks the policy to
+   move on to the next frame and whether to evict it. */
+struct replacement_policy
+  {
+    const char *name;                   /* Name for the -rp option. */
+    struct frame *(*advance) (void);    /* Returns the next frame. */
+    bool (*evictable) (struct frame *); /* Should the frame go now? */
+  };
+
+static struct frame *clock_advance (void);
+static bool clock_evictable (struct frame *f);
+static struct frame *wsclock_advance (void);
+static bool wsclock_evictable (struct frame *f);
+
+static const struct replacement_policy policies[] =
+  {
+    {"clock", clock_advance, clock_evictable},
+    {"wsclock", wsclock_advance, wsclock_evictable},
+  };
+
+/* -rp: Replacement policy in use. */
+static const struct replacement_policy *policy = &policies[0];
+
+/* WSClock working set window, in ticks of the owning process's
+   run time.  Pages accessed more recently are in the working
+   set. */
+#define WS_WINDOW 50
+
+/* Statistics. */
+static long long victim_cnt;          /* # of victims chosen. */
+static long long scan_cnt;            /* # of frames scanned. */
+static long long scan_max;            /* Most frames scanned at once. */
+static long long fallback_cnt;        /* # of accessed victims. */
+static long long busy_cnt;            /* # of scans finding no frame. */
+static long long own_cnt;             /* # of victims over RSS limits. */
+
+/* Maximum number of frames evicted at once.  Their pages are
+   written to consecutive swap slots. */
+#define EVICT_BATCH 8
+
+/* A frame of zeros that is mapped read-only by pages that have
+   never been written.  It is not in the frame table, so it is
+   never evicted, and it stays pinned, so it is never freed. */
+static struct frame zero_frame;
+
+/* Page-out daemon.  It is woken when fewer than pageout_low user
+   frames are free, and evicts frames until pageout_high are free,
+   so that frame_alloc() rarely has to evict on its own. */
+static struct condition pageout_cond;
+static size_t pageout_low;
+static size_t pageout_high;
+
+/* Read-only file frames that may be mapped by several processes,
+   keyed by inode and offset. */
+static struct hash shared_frames;
+
+static struct frame *get_frame (enum palloc_flags flags,
+                                struct thread *owner);
 static struct frame *create_frame (void *kaddr);
-static struct list_elem *clock_next (void);
-static struct frame *clock_algorithm (void);
+static void remove_frame (struct frame *f);
+static void add_page (struct frame *f, struct page *p);
+static void remove_page (struct frame *f, struct page *p);
+static bool rss_exceeded (struct thread *t);
+static struct frame *evict_own_frame (struct thread *owner);
+static struct list_elem *clock_next (struct list_elem *hand);
+static bool frame_accessed (struct frame *f, bool clear);
+static struct frame *clock_algorithm (bool wait);
 static struct frame *frame_evict (void);
+static size_t evict_frames (bool wait, struct frame **keep);
+static size_t evict_victims (struct frame **victims, size_t victim_cnt,
+                             struct frame **keep);
+static bool evict_pages (struct frame *f, size_t *swap_idx);
+static void release_frame (struct frame *f);
+static void wait_for_evictor (struct frame *f);
+static void pageout_wake (void);
+static thread_func pageout_daemon NO_RETURN;
+
+static unsigned frame_hash (const struct hash_elem *f_, void *aux UNUSED);
+static bool frame_less (const struct hash_elem *a_,
+                        const struct hash_elem *b_, void *aux UNUSED);
 
 /* Initializes the frame table and the frame lock. */
 void
@@ -25,8 +124,41 @@ frame_init (void)
 {
   list_init (&frame_table);
   lock_init (&frame_lock);
+  cond_init (&frame_cond);
+  hash_init (&shared_frames, frame_hash, frame_less, NULL);
+
+  clock_hand = front_hand = list_head (&frame_table);
+
+  zero_frame.kaddr = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  zero_frame.inode = NULL;
+  list_init (&zero_frame.pages);
+  zero_frame.state = FRAME_PINNED;
+  zero_frame.pin_cnt = 1;
+
+  /* Keep about 1/16 of the user pool free. */
+  cond_init (&pageout_cond);
+  pageout_high = palloc_user_page_cnt () / 16;
+  pageout_low = pageout_high / 2;
+  thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+}
+
+/* Selects the page replacement policy called NAME, "clock" for
+   the two-handed clock or "wsclock" for WSClock.  May be called
+   before frame_init().  Returns false if there is no such
+   policy. */
+bool
+frame_set_policy (const char *name)
+{
+  size_t i;
 
-  clock_hand = list_head (&frame_table);
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp (name, policies[i].name))
+      {
+        policy = &policies[i];
+        return true;
+      }
+
+  return false;
 }
 
 /* Allocates a frame and marks it for the given user address.
@@ -34,70 +166,498 @@ frame_init (void)
    of a previously-allocated frame. */
 struct frame*
 frame_alloc (struct page *p, enum palloc_flags flags)
+{
+  struct frame *f = get_frame (flags, p->thread);
+
+  if (f != NULL)
+    frame_share (f, p);
+
+  return f;
+}
+
+/* Like frame_alloc(), but only uses an unallocated frame and never
+   evicts.  Returns a null pointer if there is none, or if P's
+   process is at its resident set limit. */
+struct frame *
+frame_try_alloc (struct page *p, enum palloc_flags flags)
 {
   struct frame *f = NULL;
+  void *kaddr;
+
+  if (rss_exceeded (p->thread))
+    return NULL;
 
-  /* Attempt to allocate a frame from the user pool*/
-  void *kaddr = palloc_get_page (PAL_USER | flags);
+  kaddr = palloc_get_page (PAL_USER | flags);
+
+  pageout_wake ();
 
   if (kaddr != NULL)
+    f = create_frame (kaddr);
+  if (f != NULL)
+    frame_share (f, p);
+
+  return f;
+}
+
+/* Looks for an installed frame that holds READ_BYTES bytes of
+   INODE starting at offset OFS.  If there is one, P is added to
+   the pages mapping it and the frame is returned.  The frame is
+   already installed, so the caller must not install it again.
+   Returns a null pointer if there is no such frame. */
+struct frame *
+frame_lookup (struct page *p, struct inode *inode, off_t ofs,
+              size_t read_bytes)
+{
+  struct frame key;
+  struct hash_elem *e;
+  struct frame *f = NULL;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+
+  lock_acquire (&frame_lock);
+  e = hash_find (&shared_frames, &key.hash_elem);
+  if (e != NULL)
     {
-      /* Successfully allocate physical frame. 
-         So, create a frame struct. */
-      f = create_frame (kaddr);
+      f = hash_entry (e, struct frame, hash_elem);
+      add_page (f, p);
     }
-    else
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Adds page P, whose lock the caller holds, to the pages mapping
+   frame F. */
+void
+frame_share (struct frame *f, struct page *p)
+{
+  lock_acquire (&frame_lock);
+  add_page (f, p);
+  lock_release (&frame_lock);
+}
+
+/* Adds page P, whose lock the caller holds, to the pages mapping
+   the zero frame, and returns the zero frame.  It is installed
+   already and must never be written. */
+struct frame *
+frame_zero (struct page *p)
+{
+  frame_share (&zero_frame, p);
+  return &zero_frame;
+}
+
+/* Returns true if F is the zero frame. */
+bool
+frame_is_zero (struct frame *f)
+{
+  return f == &zero_frame;
+}
+
+/* Returns true if more than one page maps frame F, or if F is the
+   zero frame. */
+bool
+frame_is_shared (struct frame *f)
+{
+  bool shared;
+
+  if (frame_is_zero (f))
+    return true;
+
+  lock_acquire (&frame_lock);
+  shared = list_begin (&f->pages) != list_rbegin (&f->pages);
+  lock_release (&frame_lock);
+
+  return shared;
+}
+
+/* Gives page P, which maps the installed frame F together with
+   other pages, a private copy of F.  The caller holds P's lock.
+   Returns the frame P maps from now on, which the caller must
+   install, or a null pointer if no frame could be allocated. */
+struct frame *
+frame_copy (struct frame *f, struct page *p)
+{
+  struct frame *copy;
+
+  lock_acquire (&frame_lock);
+  wait_for_evictor (f);
+
+  /* The other pages may have been evicted or destroyed
+     meanwhile.  Then P can simply keep F, unless it is pinned. */
+  if (list_begin (&f->pages) == list_rbegin (&f->pages)
+      && f->state == FRAME_RESIDENT)
     {
-      /* Failed to allocate a frame. Evict an existing frame */
-      f = frame_evict ();
-      if (f == NULL)
-        return NULL;
+      f->state = FRAME_LOADING;
+      lock_release (&frame_lock);
+      return f;
+    }
+  lock_release (&frame_lock);
 
-      /* Zero out the page if requested */
-      if (flags & PAL_ZERO)
-        memset (f->kaddr, 0, PGSIZE); 
+  /* Keep F from being evicted while copying it. */
+  frame_pin (f);
+  copy = get_frame (0, p->thread);
+  if (copy != NULL)
+    {
+      memcpy (copy->kaddr, f->kaddr, PGSIZE);
+
+      lock_acquire (&frame_lock);
+      remove_page (f, p);
+      add_page (copy, p);
+      lock_release (&frame_lock);
     }
 
-  f->thread = thread_current ();
-  f->page = p;
+  /* Frees F if the other pages have gone away while copying. */
+  frame_unpin (f);
 
-  return f;
+  return copy;
+}
+
+/* Marks the not yet installed frame F as holding READ_BYTES
+   bytes of INODE starting at offset OFS, so that other processes
+   can find it with frame_lookup() once it is installed.  The
+   contents must never be modified. */
+void
+frame_set_shared (struct frame *f, struct inode *inode, off_t ofs,
+                  size_t read_bytes)
+{
+  ASSERT (inode != NULL);
+
+  f->inode = inode;
+  f->ofs = ofs;
+  f->read_bytes = read_bytes;
 }
 
-/* install the frame into the frame list. 
+/* install the frame into the frame list.
    After installed, the frame can be evicted. */
 void
 frame_install (struct frame *f)
 {
   lock_acquire (&frame_lock);
-  sema_up (&f->sema);
+  ASSERT (f->state == FRAME_LOADING || f->state == FRAME_EVICTING);
+
+  /* Publish shared frames.  If another process has just read the
+     same contents into its own frame, keep this one private. */
+  if (f->inode != NULL
+      && hash_insert (&shared_frames, &f->hash_elem) != NULL)
+    f->inode = NULL;
+
+  if (f->state == FRAME_EVICTING)
+    cond_broadcast (&frame_cond, &frame_lock);
+  f->state = FRAME_RESIDENT;
   lock_release (&frame_lock);
 }
 
-/* Deallocates a frame. */
+/* Keeps the installed frame F in memory until frame_unpin().
+   Pins nest.  The caller must hold the lock of a page mapping F,
+   so that F cannot be freed meanwhile. */
 void
-frame_free (struct frame *f)
+frame_pin (struct frame *f)
 {
-  /* Wait for the frame is installed. */
-  sema_down (&f->sema);
+  if (frame_is_zero (f))
+    return;
 
-  /* Prevent from the thread which does not own the frame */
-  if (thread_current () != f->thread)
+  lock_acquire (&frame_lock);
+  wait_for_evictor (f);
+  ASSERT (f->state == FRAME_RESIDENT || f->state == FRAME_PINNED);
+  f->state = FRAME_PINNED;
+  f->pin_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Undoes one frame_pin() of frame F.  When the last pin goes, F
+   may be evicted again, or is deallocated if no page maps it any
+   more. */
+void
+frame_unpin (struct frame *f)
+{
+  bool last = false;
+
+  if (frame_is_zero (f))
     return;
 
   lock_acquire (&frame_lock);
+  ASSERT (f->state == FRAME_PINNED && f->pin_cnt > 0);
+  if (--f->pin_cnt == 0)
+    {
+      f->state = FRAME_RESIDENT;
+      last = list_empty (&f->pages);
+      if (last)
+        {
+          if (f->inode != NULL)
+            hash_delete (&shared_frames, &f->hash_elem);
+          remove_frame (f);
+        }
+    }
+  lock_release (&frame_lock);
 
-  /* If the clock hand aim to this frame, move to next frame */
-  if (&f->elem == clock_hand)
-    clock_next ();
-  list_remove (&f->elem);
+  if (last)
+    {
+      palloc_free_page (f->kaddr);
+      free (f);
+    }
+}
+
+/* Waits until no evictor owns frame F.  An evictor gives F back
+   as soon as it fails to lock a page, so the caller may hold the
+   lock of a page mapping F. */
+static void
+wait_for_evictor (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  while (f->state == FRAME_EVICTING)
+    cond_wait (&frame_cond, &frame_lock);
+}
+
+/* Removes page P, whose lock the caller holds, from the pages
+   mapping frame F, clears its frame pointer, and deallocates the
+   frame when no page maps it any more.  Only a resident frame is
+   deallocated here.  A frame that is being loaded or evicted is
+   left to its owner, and a pinned one to frame_unpin(). */
+void
+frame_free (struct frame *f, struct page *p)
+{
+  bool last;
+
+  lock_acquire (&frame_lock);
+
+  remove_page (f, p);
+  p->frame = NULL;
+  if (f->state == FRAME_EVICTING)
+    {
+      /* An evictor is done with P, see frame_free_table(). */
+      cond_broadcast (&frame_cond, &frame_lock);
+    }
+  last = list_empty (&f->pages) && f->state == FRAME_RESIDENT;
+  if (last)
+    {
+      if (f->inode != NULL)
+        hash_delete (&shared_frames, &f->hash_elem);
+
+      remove_frame (f);
+    }
 
   lock_release (&frame_lock);
-  
-  palloc_free_page(f->kaddr);
-  free (f);
+
+  if (last)
+    {
+      palloc_free_page(f->kaddr);
+      free (f);
+    }
 }
-
+
+/* Removes every page in PAGE_TABLE from its frame under a single
+   acquisition of the frame lock, and deallocates the frames that
+   no page maps any more, like frame_free().  The owner of the pages
+   must be exiting, so that no evictor starts on them, see
+   page_evict().  An evictor may still have read one of them from
+   its frame's pages already, see evict_pages(), so pages of frames
+   being evicted are waited for.  Their mappings are left alone. */
+void
+frame_free_table (struct hash *page_table)
+{
+  struct list dead;
+  struct hash_iterator i;
+
+  list_init (&dead);
+
+  lock_acquire (&frame_lock);
+  hash_first (&i, page_table);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct frame *f;
+
+      /* The evictor either evicts P, which clears its frame, or
+         gives the frame back. */
+      while (p->frame != NULL && p->frame->state == FRAME_EVICTING)
+        cond_wait (&frame_cond, &frame_lock);
+
+      f = p->frame;
+      if (f == NULL)
+        continue;
+
+      remove_page (f, p);
+      p->frame = NULL;
+      if (list_empty (&f->pages) && f->state == FRAME_RESIDENT)
+        {
+          if (f->inode != NULL)
+            hash_delete (&shared_frames, &f->hash_elem);
+          remove_frame (f);
+          list_push_back (&dead, &f->elem);
+        }
+    }
+  lock_release (&frame_lock);
+
+  while (!list_empty (&dead))
+    {
+      struct frame *f = list_entry (list_pop_front (&dead), struct frame, elem);
+      palloc_free_page (f->kaddr);
+      free (f);
+    }
+}
+
+/* Obtains a frame that no page maps for a page of OWNER, either
+   an unallocated one or by evicting a previously-allocated frame.
+   If OWNER is at its resident set limit, one of its own frames is
+   evicted if possible. */
+static struct frame *
+get_frame (enum palloc_flags flags, struct thread *owner)
+{
+  struct frame *f = NULL;
+
+  if (rss_exceeded (owner))
+    f = evict_own_frame (owner);
+
+  if (f == NULL)
+    {
+      /* Attempt to allocate a frame from the user pool*/
+      void *kaddr = palloc_get_page (PAL_USER | flags);
+
+      pageout_wake ();
+
+      if (kaddr != NULL)
+        {
+          /* Successfully allocate physical frame.
+             So, create a frame struct. */
+          return create_frame (kaddr);
+        }
+
+      /* Failed to allocate a frame. Evict an existing frame */
+      f = frame_evict ();
+      if (f == NULL)
+        return NULL;
+    }
+
+  /* Zero out the page if requested */
+  if (flags & PAL_ZERO)
+    memset (f->kaddr, 0, PGSIZE);
+
+  /* Nobody else can see the frame until it is installed. */
+  f->inode = NULL;
+
+  return f;
+}
+
+/* Adds page P to the pages mapping frame F, and accounts for it
+   in the memory usage of the processes involved. */
+static void
+add_page (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (f != &zero_frame)
+    {
+      p->thread->vm_resident++;
+      if (!list_empty (&f->pages))
+        {
+          /* The page that mapped F alone now shares it. */
+          if (list_begin (&f->pages) == list_rbegin (&f->pages))
+            list_entry (list_front (&f->pages), struct page,
+                        frame_elem)->thread->vm_shared++;
+          p->thread->vm_shared++;
+        }
+    }
+
+  list_push_back (&f->pages, &p->frame_elem);
+}
+
+/* Removes page P from the pages mapping frame F, and accounts for
+   it in the memory usage of the processes involved. */
+static void
+remove_page (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  list_remove (&p->frame_elem);
+
+  if (f != &zero_frame)
+    {
+      p->thread->vm_resident--;
+      if (!list_empty (&f->pages))
+        {
+          /* The last page left maps F alone. */
+          if (list_begin (&f->pages) == list_rbegin (&f->pages))
+            list_entry (list_front (&f->pages), struct page,
+                        frame_elem)->thread->vm_shared--;
+          p->thread->vm_shared--;
+        }
+    }
+}
+
+/* Returns true if process T may not have more pages resident. */
+static bool
+rss_exceeded (struct thread *t)
+{
+  return rss_limit > 0 && t->vm_resident >= rss_limit;
+}
+
+/* Evicts a frame that only pages of OWNER map and returns it, for
+   a process at its resident set limit.  Frames that have not been
+   accessed since the last scan are preferred.  Returns a null
+   pointer if no such frame can be evicted. */
+static struct frame *
+evict_own_frame (struct thread *owner)
+{
+  struct frame *victim = NULL;
+  struct frame *kept;
+  struct frame *fallback = NULL;
+  struct list_elem *e;
+  size_t budget, i;
+
+  lock_acquire (&frame_lock);
+
+  /* Start where the clock is, without moving it. */
+  e = clock_hand;
+  budget = clock_budget < frame_cnt ? clock_budget : frame_cnt;
+  for (i = 0; i < budget && victim == NULL; i++)
+    {
+      struct frame *f;
+      struct list_elem *pe;
+      bool own = true;
+
+      e = clock_next (e);
+      f = list_entry (e, struct frame, elem);
+      if (f->state != FRAME_RESIDENT)
+        continue;
+
+      for (pe = list_begin (&f->pages); pe != list_end (&f->pages);
+           pe = list_next (pe))
+        if (list_entry (pe, struct page, frame_elem)->thread != owner)
+          own = false;
+      if (!own || list_empty (&f->pages))
+        continue;
+
+      if (!frame_accessed (f, true))
+        victim = f;
+      else if (fallback == NULL)
+        fallback = f;
+    }
+
+  if (victim == NULL)
+    victim = fallback;
+  if (victim != NULL)
+    {
+      victim->state = FRAME_EVICTING;
+      own_cnt++;
+      if (victim->inode != NULL)
+        {
+          hash_delete (&shared_frames, &victim->hash_elem);
+          victim->inode = NULL;
+        }
+    }
+
+  lock_release (&frame_lock);
+
+  if (victim == NULL)
+    return NULL;
+
+  evict_victims (&victim, 1, &kept);
+  return kept;
+}
+
 /* Creates a frame with the kernel address. */
 static struct frame *
 create_frame (void *kaddr)
@@ -111,63 +671,228 @@ create_frame (void *kaddr)
     }
 
   f->kaddr = kaddr;
-  sema_init (&f->sema, 0);
+  f->inode = NULL;
+  list_init (&f->pages);
+  f->state = FRAME_LOADING;
+  f->pin_cnt = 0;
 
   lock_acquire (&frame_lock);
   list_push_back (&frame_table, &f->elem);
+  frame_cnt++;
   lock_release (&frame_lock);
 
   return f;
 }
 
-/* Helper function for the clock algorithm to treat the frame 
-   list as a circularly linked list. */
+/* Removes frame F from the frame table.  If a clock hand aims at
+   this frame, it is moved back to the previous one, which also
+   works if F is the only frame. */
+static void
+remove_frame (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (&f->elem == clock_hand)
+    clock_hand = list_prev (clock_hand);
+  if (&f->elem == front_hand)
+    {
+      front_hand = list_prev (front_hand);
+      if (hand_gap > 0)
+        hand_gap--;
+    }
+  list_remove (&f->elem);
+  frame_cnt--;
+  f->state = FRAME_FREE;
+}
+
+/* Helper function for the clock algorithm to treat the frame
+   list as a circularly linked list.  Returns the element after
+   HAND. */
 static struct list_elem *
-clock_next (void)
+clock_next (struct list_elem *hand)
 {
-  clock_hand = list_next (clock_hand);
-  if (clock_hand == list_end (&frame_table))
-    clock_hand = list_begin (&frame_table);
+  hand = list_next (hand);
+  if (hand == list_end (&frame_table))
+    hand = list_begin (&frame_table);
 
-  return clock_hand;
+  return hand;
 }
 
-/* Uses the clock algorithm to find the next frame for eviction. */
+/* Two-handed clock: advances both hands by one frame and returns the
+   frame under the back hand.  The front hand clears the accessed
+   bits of the frame it moves to.  It is kept clock_spread frames
+   ahead, as far as the table allows.  The gap is only tracked
+   approximately as frames come and go. */
 static struct frame *
-clock_algorithm (void)
+clock_advance (void)
 {
-  struct frame *f = NULL;
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (frame_cnt > 0);
+
+  while (hand_gap < clock_spread && hand_gap + 1 < frame_cnt)
+    {
+      front_hand = clock_next (front_hand);
+      frame_accessed (list_entry (front_hand, struct frame, elem), true);
+      hand_gap++;
+    }
+
+  front_hand = clock_next (front_hand);
+  frame_accessed (list_entry (front_hand, struct frame, elem), true);
+  clock_hand = clock_next (clock_hand);
+
+  return list_entry (clock_hand, struct frame, elem);
+}
+
+/* Two-handed clock: evicts frames that have not been accessed
+   since the front hand passed them. */
+static bool
+clock_evictable (struct frame *f)
+{
+  return !frame_accessed (f, false);
+}
+
+/* WSClock: a single hand, which is the back hand of the clock. */
+static struct frame *
+wsclock_advance (void)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (frame_cnt > 0);
+
+  clock_hand = clock_next (clock_hand);
+
+  return list_entry (clock_hand, struct frame, elem);
+}
+
+/* WSClock: evicts frames that are in no working set, that is, no
+   page mapping them has been accessed during the last WS_WINDOW
+   ticks its process ran.  Processes that do not run keep their
+   working sets, however much others scan through memory. */
+static bool
+wsclock_evictable (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (frame_accessed (f, true))
+    return false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (p->thread->vm_ticks - p->last_use <= WS_WINDOW)
+        return false;
+    }
+
+  return true;
+}
+
+/* Returns true if any page mapping frame F has been accessed
+   since the accessed bits were last cleared.  If CLEAR is true,
+   clears them. */
+static bool
+frame_accessed (struct frame *f, bool clear)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->thread->pagedir;
+
+      if (pagedir_is_accessed (pd, p->uaddr))
+        {
+          accessed = true;
+          if (!clear)
+            break;
+          pagedir_set_accessed (pd, p->uaddr, false);
+          p->last_use = p->thread->vm_ticks;
+        }
+    }
+
+  return accessed;
+}
+
+/* Uses the clock of the replacement policy to find the next frame
+   for eviction.  At most clock_budget frames are scanned.  If the
+   policy wants to keep all of them, the first resident one is taken
+   anyway.  If every frame scanned is busy, that is loading, pinned
+   or being evicted by another thread, returns a null pointer if WAIT is
+   false, and retries after yielding otherwise. */
+static struct frame *
+clock_algorithm (bool wait)
+{
+  struct frame *victim = NULL;
+  size_t scanned = 0;
 
   lock_acquire (&frame_lock);
 
-  /* the frame table is empty case. */
-  if (list_empty (&frame_table))
-    return NULL;
+  while (victim == NULL)
+    {
+      struct frame *fallback = NULL;
+      size_t budget, i;
 
-  f = list_entry (clock_next (), struct frame, elem);
+      /* the frame table is empty case. */
+      if (frame_cnt == 0)
+        break;
+
+      budget = clock_budget < frame_cnt ? clock_budget : frame_cnt;
+      if (budget == 0)
+        budget = 1;
+      for (i = 0; i < budget && victim == NULL; i++)
+        {
+          struct frame *f = policy->advance ();
+
+          scanned++;
+          if (f->state != FRAME_RESIDENT)
+            continue;
+
+          if (policy->evictable (f))
+            victim = f;
+          else if (fallback == NULL)
+            fallback = f;
+        }
 
-  /* Run clock algorithm.
-     I'm afraid of that it takes too much cycles. */
-  while (true) 
+      if (victim != NULL)
+        ;
+      else if (fallback != NULL)
+        {
+          victim = fallback;
+          fallback_cnt++;
+        }
+      else
+        {
+          busy_cnt++;
+          if (!wait)
+            break;
+
+          lock_release (&frame_lock);
+          thread_yield ();
+          lock_acquire (&frame_lock);
+        }
+    }
+
+  scan_cnt += scanned;
+  if (victim != NULL)
     {
-      if (sema_try_down (&f->sema)) 
+      victim->state = FRAME_EVICTING;
+      victim_cnt++;
+      if ((long long) scanned > scan_max)
+        scan_max = scanned;
+      vm_stats_record (VM_CLOCK_SCAN, scanned);
+
+      /* No other process may map the victim from now on. */
+      if (victim->inode != NULL)
         {
-          if (pagedir_is_accessed (f->thread->pagedir, f->page->uaddr))
-            {
-              sema_up (&f->sema);
-              pagedir_set_accessed (f->thread->pagedir, f->page->uaddr, false);
-            }
-          else
-            {
-              break;
-            }
+          hash_delete (&shared_frames, &victim->hash_elem);
+          victim->inode = NULL;
         }
-      f = list_entry (clock_next (), struct frame, elem);
     }
 
   lock_release (&frame_lock);
 
-  return f;
+  return victim;
 }
 
 /* Evicts a frame from the frame table and returns it. */
@@ -175,20 +900,205 @@ static struct frame *
 frame_evict (void)
 {
   struct frame *f = NULL;
-  bool success = false;
 
-  while (!success)
+  while (f == NULL)
     {
-      /* Choose a frame to evict using clock algorithm. */
-      f = clock_algorithm ();
+      bool empty;
 
       /* Could not find a frame to evict. */
-      if (f == NULL)
+      lock_acquire (&frame_lock);
+      empty = list_empty (&frame_table);
+      lock_release (&frame_lock);
+      if (empty)
         return NULL;
 
-      /* Need to try to evict the page. */
-      success = page_evict (f->page);
+      evict_frames (true, &f);
     }
-  
+
   return f;
 }
+
+/* Evicts up to EVICT_BATCH frames at once, so that modified pages
+   are written to swap in one sequential run.  If WAIT is true,
+   waits for the clock to find the first victim.  If KEEP is
+   non-null, the first evicted frame is stored in *KEEP, or a null
+   pointer if none, and the others are given back to the page
+   allocator for the next allocations.
+   Returns the number of frames evicted. */
+static size_t
+evict_frames (bool wait, struct frame **keep)
+{
+  struct frame *victims[EVICT_BATCH];
+  size_t victim_cnt;
+
+  /* Choose frames to evict using clock algorithm.  Only the
+     first one is waited for. */
+  for (victim_cnt = 0; victim_cnt < EVICT_BATCH; victim_cnt++)
+    {
+      victims[victim_cnt] = clock_algorithm (wait && victim_cnt == 0);
+      if (victims[victim_cnt] == NULL)
+        break;
+    }
+
+  return evict_victims (victims, victim_cnt, keep);
+}
+
+/* Evicts the VICTIM_CNT frames in VICTIMS, which the caller owns
+   in the evicting state.  KEEP is as for evict_frames().
+   Returns the number of frames evicted. */
+static size_t
+evict_victims (struct frame **victims, size_t victim_cnt,
+               struct frame **keep)
+{
+  size_t slot_cnt, first_slot;
+  size_t evicted_cnt = 0;
+  size_t i;
+
+  if (keep != NULL)
+    *keep = NULL;
+
+  /* Each victim gets its own slot, if there are enough
+     contiguous ones.  Otherwise swap_out() finds one. */
+  slot_cnt = victim_cnt;
+  first_slot = swap_reserve (&slot_cnt);
+
+  for (i = 0; i < victim_cnt; i++)
+    {
+      size_t swap_idx = i < slot_cnt ? first_slot + i : SWAP_IDX_NONE;
+      uint64_t start = vm_stats_now ();
+      bool evicted = evict_pages (victims[i], &swap_idx);
+
+      /* Pages that were swapped out hold their own references
+         to the slot. */
+      if (swap_idx != SWAP_IDX_NONE)
+        swap_free (swap_idx);
+
+      if (!evicted)
+        {
+          /* The frame can be evicted again later. */
+          frame_install (victims[i]);
+          continue;
+        }
+
+      vm_stats_since (VM_EVICTION, start);
+      evicted_cnt++;
+      if (keep != NULL && *keep == NULL)
+        {
+          /* Nobody else can see the frame until the caller
+             installs it. */
+          lock_acquire (&frame_lock);
+          victims[i]->state = FRAME_LOADING;
+          lock_release (&frame_lock);
+          *keep = victims[i];
+        }
+      else
+        release_frame (victims[i]);
+    }
+
+  return evicted_cnt;
+}
+
+/* Tries to evict every page mapping frame F, which the caller
+   owns in the evicting state.  All of them have the same contents, so they share
+   a single swap slot, see page_evict().
+   Returns true if no page maps F any more. */
+static bool
+evict_pages (struct frame *f, size_t *swap_idx)
+{
+  bool written = false;
+
+  while (true)
+    {
+      struct page *p = NULL;
+
+      lock_acquire (&frame_lock);
+      if (!list_empty (&f->pages))
+        p = list_entry (list_front (&f->pages), struct page, frame_elem);
+      lock_release (&frame_lock);
+
+      if (p == NULL)
+        return true;
+      if (!page_evict (p, swap_idx, &written))
+        return false;
+    }
+}
+
+/* Removes the evicted frame F from the frame table and returns
+   its memory to the page allocator. */
+static void
+release_frame (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  remove_frame (f);
+  lock_release (&frame_lock);
+
+  palloc_free_page (f->kaddr);
+  free (f);
+}
+
+/* Prints frame replacement statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %s policy, %lld victims, %lld frames scanned (at most %lld), "
+          "%lld accessed victims, %lld busy scans, "
+          "%lld victims over RSS limits\n",
+          policy->name, victim_cnt, scan_cnt, scan_max, fallback_cnt,
+          busy_cnt, own_cnt);
+}
+
+/* Wakes up the page-out daemon if free user frames run low. */
+static void
+pageout_wake (void)
+{
+  if (palloc_user_free_cnt () < pageout_low)
+    {
+      lock_acquire (&frame_lock);
+      cond_signal (&pageout_cond, &frame_lock);
+      lock_release (&frame_lock);
+    }
+}
+
+/* Page-out daemon.  Evicts frames ahead of demand, writing out
+   their modified pages, whenever free user frames run low. */
+static void
+pageout_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      /* Every allocation below the low watermark wakes us up
+         again, so a wake-up that comes while we are busy does
+         not need to be remembered. */
+      lock_acquire (&frame_lock);
+      cond_wait (&pageout_cond, &frame_lock);
+      lock_release (&frame_lock);
+
+      /* Stop early if every frame is in use right now. */
+      while (palloc_user_free_cnt () < pageout_high
+             && evict_frames (false, NULL) > 0)
+        continue;
+    }
+}
+
+/* Returns a hash value for shared frame f. */
+static unsigned
+frame_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, hash_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if shared frame a precedes shared frame b. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, hash_elem);
+  const struct frame *b = hash_entry (b_, struct frame, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
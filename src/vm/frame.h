@@ -1,26 +1,70 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <hash.h>
 #include <list.h>
 #include <stdbool.h>
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "vm/page.h"
 
+struct inode;
+struct page;
+
+/* States of a frame.  Only a resident frame may be chosen for
+   eviction.  Transitions happen under the frame lock. */
+enum frame_state
+  {
+    FRAME_LOADING,              /* Being filled, not yet installed. */
+    FRAME_RESIDENT,             /* Installed. */
+    FRAME_PINNED,               /* Installed and kept in memory. */
+    FRAME_EVICTING,             /* Owned by an evictor. */
+    FRAME_FREE                  /* Out of the frame table. */
+  };
+
 /* Frame. */
 struct frame
   {
-    struct thread *thread;      /* Thread. */
-    void *kaddr;                /* User virtual address. */
-    struct page *page;          /* Kernel virtual address. */
+    void *kaddr;                /* Kernel virtual address. */
+    struct list pages;          /* Pages mapping this frame. */
     struct list_elem elem;      /* List element. */
-    struct semaphore sema;      /* Semaphore. */
+    enum frame_state state;     /* State. */
+    unsigned pin_cnt;           /* Number of pins, if pinned. */
+
+    /* Shared read-only file frames. */
+    struct inode *inode;        /* Inode of the contents, or NULL. */
+    off_t ofs;                  /* Offset of the contents in INODE. */
+    size_t read_bytes;          /* Bytes of INODE in the frame. */
+    struct hash_elem hash_elem; /* Element in shared frame table. */
   };
 
+/* Two-handed clock parameters, see frame.c. */
+extern size_t clock_spread;
+extern size_t clock_budget;
+
+/* Resident set limit per process, see frame.c. */
+extern size_t rss_limit;
+
+bool frame_set_policy (const char *name);
 void frame_init (void);
 struct frame* frame_alloc (struct page *p, enum palloc_flags flags);
+struct frame *frame_try_alloc (struct page *p, enum palloc_flags flags);
+struct frame *frame_lookup (struct page *p, struct inode *inode, off_t ofs,
+                            size_t read_bytes);
+void frame_set_shared (struct frame *f, struct inode *inode, off_t ofs,
+                       size_t read_bytes);
+struct frame *frame_zero (struct page *p);
+bool frame_is_zero (struct frame *f);
+void frame_share (struct frame *f, struct page *p);
+bool frame_is_shared (struct frame *f);
+struct frame *frame_copy (struct frame *f, struct page *p);
 void frame_install (struct frame *f);
-void frame_free (struct frame *f);
+void frame_pin (struct frame *f);
+void frame_unpin (struct frame *f);
+void frame_free (struct frame *f, struct page *p);
+void frame_free_table (struct hash *page_table);
+void frame_print_stats (void);
 
 #endif /* vm/frame.h */
@@ -0,0 +1,219 @@
+#include "vm/lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* A small LZ77 compressor in the style of LZ4, fast enough to
+   compress pages on their way to swap.
+
+   The output is a series of sequences.  Each one starts with a
+   token byte, whose upper 4 bits are the number of literal bytes
+   and whose lower 4 bits are the length of the match minus
+   MIN_MATCH.  A value of 15 is continued in extra bytes that are
+   added to it, up to and including the first one below 255.  The
+   literal length is followed by the literals, and then by the
+   offset of the match, as 2 bytes in little-endian order,
+   followed by the match length.  The last sequence ends after
+   its literals, where the output is complete. */
+
+/* Shortest match worth encoding. */
+#define MIN_MATCH 4
+
+static uint32_t read32 (const uint8_t *p);
+static unsigned hash4 (const uint8_t *p);
+static bool emit_sequence (uint8_t **op, uint8_t *op_end,
+                           const uint8_t *lit, size_t lit_len,
+                           size_t offset, size_t match_len);
+static uint8_t *put_length (uint8_t *op, size_t length);
+static bool get_length (const uint8_t **ip, const uint8_t *ip_end,
+                        size_t *length);
+
+/* Compresses the SRC_LEN bytes at SRC into the DST_SIZE bytes at
+   DST, using TABLE as scratch space.  TABLE need not be
+   initialized, but may not be used by anyone else meanwhile.
+   Returns the size of the compressed data, or 0 if it does not
+   fit into DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_, size_t dst_size,
+             uint16_t table[LZ_HASH_SIZE])
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + src_len;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+
+  ASSERT (src_len <= UINT16_MAX);
+
+  while (src_len >= MIN_MATCH && ip <= end - MIN_MATCH)
+    {
+      unsigned h = hash4 (ip);
+      const uint8_t *ref = src + table[h];
+
+      table[h] = ip - src;
+
+      /* Stale entries are caught by comparing the bytes. */
+      if (ref < ip && read32 (ref) == read32 (ip))
+        {
+          size_t match_len = MIN_MATCH;
+
+          while (ip + match_len < end && ref[match_len] == ip[match_len])
+            match_len++;
+
+          if (!emit_sequence (&op, dst + dst_size, anchor, ip - anchor,
+                              ip - ref, match_len))
+            return 0;
+          ip += match_len;
+          anchor = ip;
+        }
+      else
+        ip++;
+    }
+
+  if (!emit_sequence (&op, dst + dst_size, anchor, end - anchor, 0, 0))
+    return 0;
+
+  return op - dst;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, produced by
+   lz_compress(), into exactly DST_LEN bytes at DST.
+   Returns false if the data is corrupt. */
+bool
+lz_decompress (const void *src, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *ip = src;
+  const uint8_t *ip_end = ip + src_len;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_len;
+
+  while (op < op_end)
+    {
+      size_t lit_len, match_len, offset;
+      const uint8_t *ref;
+      unsigned token;
+
+      if (ip >= ip_end)
+        return false;
+      token = *ip++;
+
+      /* Literals. */
+      lit_len = token >> 4;
+      if (lit_len == 15 && !get_length (&ip, ip_end, &lit_len))
+        return false;
+      if (lit_len > (size_t) (ip_end - ip)
+          || lit_len > (size_t) (op_end - op))
+        return false;
+      memcpy (op, ip, lit_len);
+      ip += lit_len;
+      op += lit_len;
+      if (op == op_end)
+        break;
+
+      /* Match.  It may overlap the bytes it produces, so copy it
+         a byte at a time. */
+      if (ip_end - ip < 2)
+        return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      match_len = token & 15;
+      if (match_len == 15 && !get_length (&ip, ip_end, &match_len))
+        return false;
+      match_len += MIN_MATCH;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || match_len > (size_t) (op_end - op))
+        return false;
+
+      for (ref = op - offset; match_len > 0; match_len--)
+        *op++ = *ref++;
+    }
+
+  return true;
+}
+
+/* Returns the 4 bytes at P as a 32-bit integer. */
+static uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Returns the hash table index for the 4 bytes at P. */
+static unsigned
+hash4 (const uint8_t *p)
+{
+  return (read32 (p) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends a sequence of the LIT_LEN literals at LIT and a match
+   of MATCH_LEN bytes OFFSET bytes back to *OP, or only the
+   literals if MATCH_LEN is 0, and advances *OP past it.
+   Returns false if it would not fit before OP_END. */
+static bool
+emit_sequence (uint8_t **op_, uint8_t *op_end, const uint8_t *lit,
+               size_t lit_len, size_t offset, size_t match_len)
+{
+  uint8_t *op = *op_;
+  size_t ml = match_len > 0 ? match_len - MIN_MATCH : 0;
+  uint8_t *token;
+
+  /* Room for the token, both lengths, literals and offset. */
+  if ((size_t) (op_end - op) < 1 + lit_len / 255 + 1 + lit_len
+                               + 2 + ml / 255 + 1)
+    return false;
+
+  token = op++;
+  *token = (lit_len < 15 ? lit_len : 15) << 4;
+  if (lit_len >= 15)
+    op = put_length (op, lit_len - 15);
+  memcpy (op, lit, lit_len);
+  op += lit_len;
+
+  if (match_len > 0)
+    {
+      ASSERT (offset > 0 && offset <= UINT16_MAX);
+
+      *token |= ml < 15 ? ml : 15;
+      *op++ = offset & 0xff;
+      *op++ = offset >> 8;
+      if (ml >= 15)
+        op = put_length (op, ml - 15);
+    }
+
+  *op_ = op;
+  return true;
+}
+
+/* Writes the continuation bytes for LENGTH at OP and returns the
+   byte after them. */
+static uint8_t *
+put_length (uint8_t *op, size_t length)
+{
+  for (; length >= 255; length -= 255)
+    *op++ = 255;
+  *op++ = length;
+
+  return op;
+}
+
+/* Adds the continuation bytes at *IP to *LENGTH and advances *IP
+   past them.  Returns false if they run past IP_END. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *ip_end, size_t *length)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ip >= ip_end)
+        return false;
+      b = *(*ip)++;
+      *length += b;
+    }
+  while (b == 255);
+
+  return true;
+}
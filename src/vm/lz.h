@@ -0,0 +1,18 @@
+#ifndef VM_LZ_H
+#define VM_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of entries in the hash table lz_compress() works with.
+   Inputs must be shorter than 64 kB. */
+#define LZ_HASH_BITS 10
+#define LZ_HASH_SIZE (1u << LZ_HASH_BITS)
+
+size_t lz_compress (const void *src, size_t src_len, void *dst,
+                    size_t dst_size, uint16_t table[LZ_HASH_SIZE]);
+bool lz_decompress (const void *src, size_t src_len, void *dst,
+                    size_t dst_len);
+
+#endif /* vm/lz.h */
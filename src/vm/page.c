@@ -1,16 +1,48 @@
 #include "vm/page.h"
+#include <string.h>
+#include <user/syscall.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/stats.h"
 #include "vm/swap.h"
 
-static struct page *create_page (const void *uaddr, bool writable);
+/* Maximum number of pages swap_read_ahead() swaps in. */
+#define SWAP_READ_AHEAD 4
+
+/* Number of swap slots page_table_destroy() frees at once. */
+#define SWAP_FREE_BATCH 64
+
+/* -fa: Number of pages in the window around a faulting page that
+   page_load() maps if possible without I/O. */
+size_t fault_around = 16;
+
+/* -sm: Size of the stack region below PHYS_BASE, in bytes.  The
+   stack may grow anywhere into it, and nothing else is mapped
+   there. */
+size_t stack_max = 8 * 1024 * 1024;
+
+/* Number of pages the stack grows by at once, below the page that
+   faulted. */
+#define STACK_CHUNK 4
+
+static struct page *create_page (struct vma *v, const void *uaddr);
+static struct page *get_page (const void *uaddr);
 static void destroy_page (struct page *p);
-static bool swap_out_page (struct page *p);
-static bool swap_in_page (struct page *p);
+static void set_swapped (struct page *p, bool swapped);
+static bool load_page (struct page *p, bool write);
+static bool make_writable (struct page *p);
+static bool swap_in_page (struct page *p, bool evict);
+static void swap_read_ahead (struct page *p, size_t swap_idx);
+static bool map_resident_page (struct page *p, bool write);
+static void fault_around_page (struct page *p);
+static bool file_in_page (struct page *p);
 static bool install_page (struct page *p);
+static bool map_page (struct page *p);
+static bool file_out_page (struct page *p, bool wait);
 
-static struct page *page_lookup (const void *uaddr);
 static unsigned page_hash (const struct hash_elem *p_, 
                            void *aux UNUSED);
 static bool page_less (const struct hash_elem *a_, 
@@ -26,45 +58,55 @@ page_table_init (struct hash *page_table)
   return hash_init (page_table, page_hash, page_less, NULL);
 }
 
-/* Destroys an entry in the page table.
-   This function is called by process_exit(). */
+/* Destroys the page table of the current process, which is
+   exiting, together with all its pages.  Frames and swap slots are
+   released in batches, see frame_free_table() and swap_free_batch().
+   The page directory is not updated, because process_exit()
+   destroys it right afterwards. */
 void
 page_table_destroy (struct hash *page_table)
 {
-  ASSERT (page_table != NULL);
-  hash_destroy (page_table, page_destructor);
-}
-
-/* Adds a memory-based supplemental page table entry 
-   to the current process. */
-struct page * 
-page_alloc (const void *uaddr, bool writable)
-{
-  ASSERT (is_user_vaddr (uaddr));
-
-  struct page *p = create_page (uaddr, writable);
-
-  if (p == NULL)
-    return NULL;
+  struct hash_iterator i;
+  size_t slots[SWAP_FREE_BATCH];
+  size_t slot_cnt = 0;
 
-  p->frame = frame_alloc (p, PAL_ZERO);
+  ASSERT (page_table != NULL);
 
-  /* Failed to allocate a frame. */
-  if (p->frame == NULL)
+  /* From now on evictors leave our pages alone, see page_evict().
+     Acquiring each page lock waits for evictions in progress. */
+  thread_current ()->vm_exiting = true;
+  hash_first (&i, page_table);
+  while (hash_next (&i))
     {
-      destroy_page (p);
-      return NULL;
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      uint32_t *pd = p->thread->pagedir;
+
+      lock_acquire (&p->lock);
+      if (p->frame != NULL && p->mmap
+          && (p->dirty || pagedir_is_dirty (pd, p->uaddr)))
+        file_out_page (p, true);
+      lock_release (&p->lock);
     }
 
-  /* Try to install the page */
-  if (!install_page (p))
+  frame_free_table (page_table);
+
+  hash_first (&i, page_table);
+  while (hash_next (&i))
     {
-      frame_free (p->frame);
-      destroy_page (p);
-      return NULL;
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+
+      if (!p->swapped)
+        continue;
+      slots[slot_cnt++] = p->swap_idx;
+      if (slot_cnt == SWAP_FREE_BATCH)
+        {
+          swap_free_batch (slots, slot_cnt);
+          slot_cnt = 0;
+        }
     }
-  
-  return p;
+  swap_free_batch (slots, slot_cnt);
+
+  hash_destroy (page_table, page_destructor);
 }
 
 /* Free the page */
@@ -74,144 +116,745 @@ page_free (struct page *p)
   destroy_page (p);
 }
 
-/* Try to evict the page. */
+/* Tries to evict page P from its frame, which the caller owns in
+   the evicting state.  All pages mapping the frame have the same
+   contents, so they share one swap slot: *SWAP_IDX is the slot
+   the caller holds a reference to for the frame, or SWAP_IDX_NONE
+   to allocate one when needed, see swap_out().  *WRITTEN tells
+   whether the frame has been written to the slot already.
+   Returns false if P could not be evicted. */
 bool
-page_evict (struct page *p)
+page_evict (struct page *p, size_t *swap_idx, bool *written)
 {
   ASSERT (p != NULL);
-  
+  uint32_t *pd = p->thread->pagedir;
+  struct frame *f;
+  bool success = true;
+
+  /* The owner may wait for the frame while holding the page lock,
+     e.g. in frame_copy().  Give up the frame instead of
+     deadlocking. */
+  if (!lock_try_acquire (&p->lock))
+    return false;
+
+  /* The owner is releasing all of its frames at once. */
+  if (p->thread->vm_exiting)
+    {
+      lock_release (&p->lock);
+      return false;
+    }
+
+  f = p->frame;
+
   /* When the frame of the page is evicted,
      the present of PTE should be clear. */
-  pagedir_clear_page (p->frame->thread->pagedir, p->uaddr);
+  pagedir_clear_page (pd, p->uaddr);
+  if (pagedir_is_dirty (pd, p->uaddr))
+    p->dirty = true;
+
+  /* Clean pages are simply read in from their file, or zeroed,
+     again on the next fault.  Only modified pages need to be
+     written out. */
+  if (p->dirty && p->mmap)
+    {
+      success = file_out_page (p, false);
+      if (success)
+        p->dirty = false;
+    }
+  else if (p->dirty)
+    {
+      if (!*written)
+        success = *written = swap_out (f->kaddr, swap_idx);
+
+      if (success)
+        {
+          swap_dup (*swap_idx);
+          set_swapped (p, true);
+          p->swap_idx = *swap_idx;
+        }
+    }
+
+  if (success)
+    {
+      frame_free (f, p);
+      p->frame = NULL;
+    }
+  else
+    {
+      /* Failed to write out the page.
+         It needs to be mapped again. */
+      map_page (p);
+    }
 
-  lock_acquire (&p->lock);
-  bool success = swap_out_page (p);
   lock_release (&p->lock);
 
-  /* Failed to swap or file in the page table.
-     It needs to install again. */
-  if (!success) 
-    frame_install (p->frame);
-    
   return success;
 }
 
-/* Attempts to load the page using the supplemental page table. */
+/* Attempts to load the page using the supplemental page table.
+   WRITE tells whether the fault was caused by a write. */
 bool
-page_load (void *fault_addr)
+page_load (void *fault_addr, bool write)
 {
-  ASSERT ((void*) fault_addr < PHYS_BASE);
+  if (!is_user_vaddr (fault_addr))
+    return false;
 
   /* Align the page address. */
   fault_addr = pg_round_down (fault_addr);
 
-  struct page *p = page_lookup (fault_addr);
+  struct page *p = get_page (fault_addr);
 
   if (p == NULL)
     return false;
 
   lock_acquire (&p->lock);
-  bool success = swap_in_page (p);
+  bool success = load_page (p, write);
   lock_release (&p->lock);
 
+  if (success)
+    fault_around_page (p);
+
   return success;
 }
 
-/* Create a page entry. */
+/* Handles a write to the present but read-only page at
+   FAULT_ADDR.  If the page is writable and still shares its frame
+   with a forked process, it gets a private copy of the frame.
+   Returns false if the write is not allowed or no frame could be
+   allocated. */
+bool
+page_copy_on_write (void *fault_addr)
+{
+  if (!is_user_vaddr (fault_addr))
+    return false;
+
+  uint64_t start = vm_stats_now ();
+  struct page *p = page_lookup (pg_round_down (fault_addr));
+
+  if (p == NULL || !p->writable)
+    return false;
+
+  lock_acquire (&p->lock);
+  bool success = true;
+
+  /* If the page has been evicted meanwhile, the retried access
+     faults it in again. */
+  if (p->frame != NULL)
+    success = make_writable (p);
+  lock_release (&p->lock);
+
+  if (success)
+    vm_stats_since (VM_MINOR_FAULT, start);
+
+  return success;
+}
+
+/* Grows the stack of the current process, if FAULT_ADDR is in
+   the stack region and at most 32 bytes below ESP, the user stack
+   pointer, as for PUSHA.  The stack area is extended down to the
+   page that faulted, and then by up to STACK_CHUNK pages in all,
+   which are given frames right away, so that a deep recursion
+   does not fault on every page.  Pages skipped by a large frame
+   in between are only created when they are accessed.
+   Returns false if the access is not a stack access or memory
+   allocation fails. */
+bool
+page_grow_stack (void *fault_addr, void *esp)
+{
+  uint64_t start = vm_stats_now ();
+  struct vma *stack = thread_current ()->stack_vma;
+  uint8_t *region = (uint8_t *) PHYS_BASE - stack_max;
+  uint8_t *fault_page = pg_round_down (fault_addr);
+  uint8_t *low, *upage;
+
+  if (stack == NULL || !is_user_vaddr (fault_addr) || fault_page < region
+      || fault_page >= stack->start
+      || (uint8_t *) fault_addr + 32 < (uint8_t *) esp)
+    return false;
+
+  low = fault_page - (STACK_CHUNK - 1) * PGSIZE;
+  if (low < region || low > fault_page || !vma_is_free (low, stack->start))
+    low = fault_page;
+  if (!vma_is_free (low, stack->start))
+    return false;
+  stack->start = low;
+
+  /* The faulting page and the chunk below it. */
+  for (upage = fault_page; upage >= low; upage -= PGSIZE)
+    if (!page_load (upage, true))
+      break;
+
+  if (upage == fault_page)
+    return false;
+  vm_stats_since (VM_STACK_GROWTH, start);
+  return true;
+}
+
+/* Keeps the page at UADDR in memory until page_unpin(), so that
+   the kernel can access it without faulting, e.g. while holding
+   the file system lock.  If WRITE is true, the page is also made
+   writable for the kernel.  If UADDR is in the part of the stack
+   that has not been grown yet, the stack is grown into it as for
+   a fault at UADDR during the current system call.  Returns false
+   if there is no such page, it is read-only and WRITE is true, or
+   it could not be loaded. */
+bool
+page_pin (const void *uaddr, bool write)
+{
+  if (!is_user_vaddr (uaddr))
+    return false;
+
+  struct page *p = get_page (uaddr);
+
+  if (p == NULL
+      && page_grow_stack ((void *) uaddr, thread_current ()->user_esp))
+    p = get_page (uaddr);
+
+  if (p == NULL || (write && !p->writable))
+    return false;
+
+  lock_acquire (&p->lock);
+  bool success = load_page (p, write);
+  if (success && write
+      && !pagedir_is_writable (p->thread->pagedir, p->uaddr))
+    success = make_writable (p);
+  if (success)
+    frame_pin (p->frame);
+  lock_release (&p->lock);
+
+  return success;
+}
+
+/* Lets the page at UADDR, pinned by page_pin(), be evicted
+   again. */
+void
+page_unpin (const void *uaddr)
+{
+  struct page *p = page_lookup (pg_round_down (uaddr));
+
+  ASSERT (p != NULL && p->frame != NULL);
+
+  lock_acquire (&p->lock);
+  frame_unpin (p->frame);
+  lock_release (&p->lock);
+}
+
+/* Pins the pages of the SIZE bytes at BUFFER with page_pin().
+   Either all of them are pinned or none.  Returns false if one
+   of them cannot be pinned. */
+bool
+page_pin_buffer (const void *buffer, size_t size, bool write)
+{
+  const uint8_t *start = pg_round_down (buffer);
+  const uint8_t *end = (const uint8_t *) buffer + size;
+  const uint8_t *upage;
+
+  /* The first page is pinned by BUFFER itself, which may be just
+     below the stack pointer when the page is not. */
+  for (upage = start; upage < end; upage += PGSIZE)
+    if (!page_pin (upage == start ? buffer : upage, write))
+      {
+        page_unpin_buffer (start, upage - start);
+        return false;
+      }
+
+  return true;
+}
+
+/* Unpins the pages of the SIZE bytes at BUFFER pinned by
+   page_pin_buffer(). */
+void
+page_unpin_buffer (const void *buffer, size_t size)
+{
+  const uint8_t *end = (const uint8_t *) buffer + size;
+  const uint8_t *upage;
+
+  for (upage = pg_round_down (buffer); upage < end; upage += PGSIZE)
+    page_unpin (upage);
+}
+
+/* Stores the memory usage of the current process in the user
+   buffer MS.  Returns false if MS is not writable. */
+bool
+page_memstat (struct memstat *ms)
+{
+  struct thread *t = thread_current ();
+
+  if (!page_pin_buffer (ms, sizeof *ms, true))
+    return false;
+
+  ms->resident = t->vm_resident;
+  ms->shared = t->vm_shared;
+  ms->swapped = t->vm_swapped;
+  ms->rss_limit = rss_limit;
+
+  page_unpin_buffer (ms, sizeof *ms);
+  return true;
+}
+
+/* Copies the page table of PARENT, which must be blocked, into
+   the current process for fork().  Pages that are in memory share
+   their frames, and writable ones are mapped read-only in both
+   processes until one of them writes, see page_copy_on_write().
+   Swapped out pages share their swap slots.
+   Returns false if memory allocation fails. */
+bool
+page_table_fork (struct thread *parent)
+{
+  struct hash_iterator i;
+  bool success = true;
+
+  hash_first (&i, &parent->page_table);
+  while (success && hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *p;
+
+      /* Memory mappings are not inherited. */
+      if (pp->mmap)
+        continue;
+
+      /* Our areas are copies of the parent's, see
+         vma_table_fork(). */
+      p = create_page (vma_find (pp->uaddr), pp->uaddr);
+      if (p == NULL)
+        return false;
+
+      lock_acquire (&pp->lock);
+      lock_acquire (&p->lock);
+      p->dirty = pp->dirty;
+
+      if (pp->frame != NULL)
+        {
+          p->frame = pp->frame;
+          frame_share (p->frame, p);
+          if (pagedir_is_dirty (parent->pagedir, pp->uaddr))
+            p->dirty = true;
+          if (pp->writable)
+            pagedir_set_writable (parent->pagedir, pp->uaddr, false);
+          if (!map_page (p))
+            {
+              frame_free (p->frame, p);
+              p->frame = NULL;
+              success = false;
+            }
+        }
+      else if (pp->swapped)
+        {
+          swap_dup (pp->swap_idx);
+          set_swapped (p, true);
+          p->swap_idx = pp->swap_idx;
+        }
+
+      lock_release (&p->lock);
+      lock_release (&pp->lock);
+    }
+
+  return success;
+}
+
+/* Creates the page entry for UADDR in virtual memory area V of
+   the current process.  Returns a null pointer if V is a null
+   pointer or memory allocation fails. */
 static struct page *
-create_page (const void *uaddr, bool writable)
+create_page (struct vma *v, const void *uaddr)
 {
+  if (v == NULL)
+    return NULL;
+
   struct page *p = malloc (sizeof (struct page));
   if (p == NULL)
     return NULL;
 
   /* Page align the address. */
   void *aligned_uaddr = pg_round_down (uaddr);
+  size_t ofs = (uint8_t *) aligned_uaddr - v->start;
 
   p->uaddr = aligned_uaddr;
-  p->writable = writable;
+  p->writable = v->writable;
+  p->thread = thread_current ();
+  p->vma = v;
   p->frame = NULL;
   p->swapped = false;
+  p->file = v->file;
+  p->file_ofs = v->ofs + ofs;
+  p->read_bytes = 0;
+  if (ofs < v->read_bytes)
+    p->read_bytes = v->read_bytes - ofs < PGSIZE ? v->read_bytes - ofs : PGSIZE;
+  p->zero_bytes = PGSIZE - p->read_bytes;
+  p->mmap = v->mmap;
+  p->dirty = false;
+  p->last_use = p->thread->vm_ticks;
   lock_init (&p->lock);
 
-  /* Install into hash table. */
-  hash_insert (&thread_current ()->page_table, &p->hash_elem);
+  /* Install into hash table.  Fails if the address is already
+     mapped. */
+  if (hash_insert (&thread_current ()->page_table, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  list_push_back (&v->pages, &p->vma_elem);
+
+  return p;
+}
+
+/* Returns the page entry for UADDR in the current process,
+   creating it if UADDR is in one of its virtual memory areas.
+   Returns a null pointer if UADDR is not mapped or memory
+   allocation fails. */
+static struct page *
+get_page (const void *uaddr)
+{
+  struct page *p = page_lookup (pg_round_down (uaddr));
+
+  if (p == NULL)
+    p = create_page (vma_find (uaddr), uaddr);
 
   return p;
 }
 
+/* Brings page P, whose lock the caller holds, into a frame.
+   WRITE tells whether it is about to be written.  The page may
+   already be back in a frame, e.g. if it is being evicted right
+   now.  Then there is nothing to do.  Pages of zeros are mapped
+   to the shared zero frame unless WRITE is true, and read-only
+   file pages to a frame another process has read them into. */
+static bool
+load_page (struct page *p, bool write)
+{
+  uint64_t start = vm_stats_now ();
+
+  if (p->frame != NULL)
+    return true;
+  else if (p->swapped)
+    {
+      size_t swap_idx = p->swap_idx;
+      bool success = swap_in_page (p, true);
+
+      if (success)
+        {
+          vm_stats_since (VM_SWAP_IN, start);
+          swap_read_ahead (p, swap_idx);
+        }
+      return success;
+    }
+  else if (map_resident_page (p, write))
+    {
+      vm_stats_since (VM_MINOR_FAULT, start);
+      return true;
+    }
+  else
+    {
+      bool success = file_in_page (p);
+
+      if (success)
+        vm_stats_since (p->read_bytes > 0 ? VM_FILE_IN : VM_MINOR_FAULT,
+                        start);
+      return success;
+    }
+}
+
+/* Makes the writable page P, which is in a frame and whose lock
+   the caller holds, writable in the page directory.  If its frame
+   is still shared with a forked process, it gets a private copy
+   of the frame first. */
+static bool
+make_writable (struct page *p)
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  if (frame_is_zero (p->frame))
+    {
+      /* Never written so far. */
+      frame_free (p->frame, p);
+      p->frame = NULL;
+      pagedir_clear_page (pd, p->uaddr);
+      return file_in_page (p);
+    }
+  else if (!frame_is_shared (p->frame))
+    {
+      /* The other processes have dropped the frame. */
+      pagedir_set_writable (pd, p->uaddr, true);
+      return true;
+    }
+  else
+    {
+      struct frame *f = frame_copy (p->frame, p);
+      if (f == NULL)
+        return false;
+
+      p->frame = f;
+      pagedir_clear_page (pd, p->uaddr);
+      if (pagedir_is_dirty (pd, p->uaddr))
+        p->dirty = true;
+      return install_page (p);
+    }
+}
+
 /* Destroy the page. */
 static void
-destroy_page_ (struct page *p)
+destroy_page (struct page *p)
 {
   lock_acquire (&p->lock);
-  struct frame *f = p->frame;
-  lock_release (&p->lock);
 
   /* Free the frame object if allocated */
-  if (f != NULL)
+  if (p->frame != NULL)
     {
-      pagedir_clear_page (f->thread->pagedir, p->uaddr);
-      frame_free (p->frame);
+      uint32_t *pd = p->thread->pagedir;
+
+      pagedir_clear_page (pd, p->uaddr);
+      if (p->mmap && (p->dirty || pagedir_is_dirty (pd, p->uaddr)))
+        file_out_page (p, true);
+      frame_free (p->frame, p);
+      p->frame = NULL;
     }
 
-  lock_acquire (&p->lock);
   if (p->swapped)
-    swap_free (p->swap_idx);
+    {
+      swap_free (p->swap_idx);
+      set_swapped (p, false);
+    }
 
+  list_remove (&p->vma_elem);
   lock_release (&p->lock);
+
+  hash_delete (&thread_current ()->page_table, &p->hash_elem);
+  free (p);
 }
 
-/* Destroy the page. */
+/* Marks page P as swapped out or not, and accounts for it in
+   the memory usage of its process.  Evictors update the count of
+   other processes, so it is changed with interrupts off. */
 static void
-destroy_page (struct page *p)
+set_swapped (struct page *p, bool swapped)
 {
-  destroy_page_ (p);
-  hash_delete (&thread_current ()->page_table, &p->hash_elem);
-  free (p);
+  enum intr_level old_level;
+
+  ASSERT (p->swapped != swapped);
+
+  p->swapped = swapped;
+  old_level = intr_disable ();
+  if (swapped)
+    p->thread->vm_swapped++;
+  else
+    p->thread->vm_swapped--;
+  intr_set_level (old_level);
 }
 
-/* Swap out the page to disk. */
+/* Swap in a page into a frame.  If EVICT is false, only a free
+   frame is used. */
 static bool
-swap_out_page (struct page *p)
+swap_in_page (struct page *p, bool evict)
 {
   ASSERT (p != NULL);
   ASSERT (lock_held_by_current_thread (&p->lock));
-  ASSERT (!p->swapped);
-  ASSERT (p->frame != NULL);
+  ASSERT (p->swapped);
 
-  bool success = swap_out (p->frame->kaddr, &p->swap_idx);
-  if (!success) 
+  p->frame = evict ? frame_alloc (p, 0) : frame_try_alloc (p, 0);
+  if (p->frame == NULL)
     return false;
 
-  p->swapped = true;
-  p->frame = NULL;
+  swap_in (p->swap_idx, p->frame->kaddr);
+
+  /* Try to install the page */
+  if (!install_page (p))
+    {
+      frame_free (p->frame, p);
+      p->frame = NULL;
+      return false;
+    }
+
+  set_swapped (p, false);
+
+  return true;
+}
+
+/* Maps page P, which is in no frame, without any I/O if its
+   contents are in memory already: in the zero frame, unless WRITE
+   is true, or for a read-only file page in a frame installed by
+   another process.  Returns true if P was mapped. */
+static bool
+map_resident_page (struct page *p, bool write)
+{
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->frame == NULL && !p->swapped);
+
+  if (p->read_bytes == 0 && !write)
+    {
+      /* The first write gets a frame of its own, see
+         page_copy_on_write(). */
+      p->frame = frame_zero (p);
+    }
+  else if (!p->writable && p->file != NULL)
+    p->frame = frame_lookup (p, file_get_inode (p->file), p->file_ofs,
+                             p->read_bytes);
+
+  if (p->frame == NULL)
+    return false;
+
+  if (!map_page (p))
+    {
+      frame_free (p->frame, p);
+      p->frame = NULL;
+      return false;
+    }
 
   return true;
 }
 
-/* Swap in a page into a frame. */
+/* Maps the pages in the aligned window of fault_around pages
+   around P that map_resident_page() can map, so that accessing
+   them does not fault.  The window is a multiple of its size. */
+static void
+fault_around_page (struct page *p)
+{
+  uint8_t *start;
+  size_t i;
+
+  if (fault_around <= 1)
+    return;
+
+  start = (uint8_t *) p->uaddr - pg_no (p->uaddr) % fault_around * PGSIZE;
+  for (i = 0; i < fault_around; i++)
+    {
+      uint8_t *uaddr = start + i * PGSIZE;
+      struct page *q;
+      bool mapped;
+
+      if (!is_user_vaddr (uaddr))
+        break;
+      if (uaddr == p->uaddr)
+        continue;
+
+      q = page_lookup (uaddr);
+      if (q == NULL)
+        {
+          /* Only keep a new entry if it gets mapped. */
+          q = create_page (vma_find (uaddr), uaddr);
+          if (q == NULL)
+            continue;
+          lock_acquire (&q->lock);
+          mapped = map_resident_page (q, false);
+          lock_release (&q->lock);
+          if (!mapped)
+            destroy_page (q);
+          continue;
+        }
+      if (!lock_try_acquire (&q->lock))
+        continue;
+      if (q->frame == NULL && !q->swapped)
+        map_resident_page (q, false);
+      lock_release (&q->lock);
+    }
+}
+
+/* Swaps in the pages following P in virtual memory, as long as
+   they are stored in the slots following SWAP_IDX, the slot P was
+   swapped in from.  Such pages were evicted together, and reading
+   them now costs no extra seeks.  Only free frames are used. */
+static void
+swap_read_ahead (struct page *p, size_t swap_idx)
+{
+  size_t i;
+
+  for (i = 1; i <= SWAP_READ_AHEAD; i++)
+    {
+      struct page *q = page_lookup (p->uaddr + i * PGSIZE);
+      bool next;
+
+      if (q == NULL || !lock_try_acquire (&q->lock))
+        break;
+      next = (q->frame == NULL && q->swapped
+              && q->swap_idx == swap_idx + i
+              && swap_in_page (q, false));
+      lock_release (&q->lock);
+
+      if (!next)
+        break;
+    }
+}
+
+/* Reads the page in from its backing file for the first time,
+   into a frame of its own.  Pages without a file are simply
+   zeroed.  Read-only file pages are entered into the shared frame
+   table, see map_resident_page(). */
 static bool
-swap_in_page (struct page *p)
+file_in_page (struct page *p)
 {
   ASSERT (p != NULL);
   ASSERT (lock_held_by_current_thread (&p->lock));
-  ASSERT (p->swapped);
+  ASSERT (!p->swapped);
 
-  p->frame = frame_alloc (p, 0);
+  bool shared = !p->writable && p->file != NULL;
+  struct inode *inode = shared ? file_get_inode (p->file) : NULL;
+
+  p->frame = frame_alloc (p, p->file == NULL ? PAL_ZERO : 0);
   if (p->frame == NULL)
     return false;
 
-  swap_in (p->swap_idx, p->frame->kaddr);
+  if (p->file != NULL)
+    {
+      /* The fault may come from a system call that already holds
+         the file system lock. */
+      bool held = lock_held_by_current_thread (&file_lock);
+      off_t read_bytes;
+
+      if (!held)
+        lock_acquire (&file_lock);
+      read_bytes = file_read_at (p->file, p->frame->kaddr,
+                                 p->read_bytes, p->file_ofs);
+      if (!held)
+        lock_release (&file_lock);
+
+      if (read_bytes != (off_t) p->read_bytes)
+        {
+          /* frame_free() only frees installed frames. */
+          frame_install (p->frame);
+          frame_free (p->frame, p);
+          p->frame = NULL;
+          return false;
+        }
+      memset (p->frame->kaddr + p->read_bytes, 0, p->zero_bytes);
+    }
+
+  if (shared)
+    frame_set_shared (p->frame, inode, p->file_ofs, p->read_bytes);
 
   /* Try to install the page */
   if (!install_page (p))
     {
-      frame_free (p->frame);
+      frame_free (p->frame, p);
+      p->frame = NULL;
       return false;
     }
 
-  p->swapped = false;
+  return true;
+}
+
+/* Writes the contents of mapped page P back to its file.
+   The frame must not be mapped any more.  If WAIT is false, gives
+   up instead of waiting for the file system lock.
+   Returns true on success, false if giving up. */
+static bool
+file_out_page (struct page *p, bool wait)
+{
+  ASSERT (p != NULL);
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->mmap && p->frame != NULL);
+
+  bool held = lock_held_by_current_thread (&file_lock);
+
+  if (!held)
+    {
+      if (wait)
+        lock_acquire (&file_lock);
+      else if (!lock_try_acquire (&file_lock))
+        return false;
+    }
+  file_write_at (p->file, p->frame->kaddr, p->read_bytes, p->file_ofs);
+  if (!held)
+    lock_release (&file_lock);
 
   return true;
 }
@@ -223,21 +866,34 @@ swap_in_page (struct page *p)
 static bool
 install_page (struct page* p)
 {
-  struct thread *t = thread_current ();
-
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  bool success = (pagedir_get_page (t->pagedir, p->uaddr) == NULL
-                  && pagedir_set_page (t->pagedir, p->uaddr, 
-                                       p->frame->kaddr, p->writable));
+  bool success = map_page (p);
 
+  /* The page is about to be accessed. */
+  p->last_use = p->thread->vm_ticks;
   frame_install (p->frame);
 
   return success;
 }
+
+/* Maps the page to its frame in the owner's page directory,
+   without installing the frame.  A frame shared with a forked
+   process is mapped read-only, so that the first write copies it.
+   Returns true on success, false if virtual address is already
+   mapped or if memory allocation fails. */
+static bool
+map_page (struct page *p)
+{
+  uint32_t *pd = p->thread->pagedir;
+  bool writable = p->writable && !frame_is_shared (p->frame);
+
+  /* Verify that there's not already a page at that virtual
+     address, then map our page there. */
+  return (pagedir_get_page (pd, p->uaddr) == NULL
+          && pagedir_set_page (pd, p->uaddr, p->frame->kaddr, writable));
+}
 
 /* Find a page witch the given uaddr from page table */
-static struct page *
+struct page *
 page_lookup (const void *uaddr)
 {
   struct hash_elem *e;
@@ -264,10 +920,12 @@ page_less (const struct hash_elem *a_, const struct hash_elem *b_,
   return (a->uaddr < b->uaddr);
 }
 
-/* Page destructor for hash destroy */
+/* Page destructor for page_table_destroy(), which has released
+   the page's frame and swap slot already. */
 static void
 page_destructor (struct hash_elem *e, void *aux UNUSED)
 {
   struct page *p = hash_entry (e, struct page, hash_elem);
-  destroy_page_ (p);
+  list_remove (&p->vma_elem);
+  free (p);
 }
@@ -8,27 +8,54 @@
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "vm/frame.h"
+#include "vm/vma.h"
 
 /* Supplemental page table entry struct . */
 struct page
   {
     void *uaddr;                /* User page address(page-aligned). */
     bool writable;              /* Page is writable or not. */
+    struct thread *thread;      /* Owner process. */
+    struct vma *vma;            /* Virtual memory area of the page. */
+    struct list_elem vma_elem;  /* Entry in VMA's page list. */
     struct frame *frame;        /* Frame entry. */
+    struct list_elem frame_elem; /* Entry in frame's page list. */
 
     bool swapped;               /* Is this block swapped. */
     size_t swap_idx;            /* The index of swap. */
 
+    struct file *file;          /* Backing file, or NULL. */
+    off_t file_ofs;             /* Offset of the page in FILE. */
+    size_t read_bytes;          /* Bytes to read from FILE. */
+    size_t zero_bytes;          /* Bytes to zero after READ_BYTES. */
+    bool mmap;                  /* Written back to FILE, not swap. */
+    bool dirty;                 /* Differs from FILE or zeros. */
+    int64_t last_use;           /* Owner's vm_ticks at last access seen. */
+
     struct lock lock;           /* Page lock. */
     struct hash_elem hash_elem; /* Entry in thread's hash table. */
   };
 
+struct memstat;
+
+/* Fault-around window and stack size limit, see page.c. */
+extern size_t fault_around;
+extern size_t stack_max;
+
 bool page_table_init (struct hash *page_table);
 void page_table_destroy (struct hash *page_table);
 
-struct page *page_alloc (const void *uaddr, bool writable);
 void page_free (struct page *p);
-bool page_evict (struct page *p);
-bool page_load (void *fault_addr);
+struct page *page_lookup (const void *uaddr);
+bool page_evict (struct page *p, size_t *swap_idx, bool *written);
+bool page_load (void *fault_addr, bool write);
+bool page_copy_on_write (void *fault_addr);
+bool page_grow_stack (void *fault_addr, void *esp);
+bool page_pin (const void *uaddr, bool write);
+void page_unpin (const void *uaddr);
+bool page_pin_buffer (const void *buffer, size_t size, bool write);
+void page_unpin_buffer (const void *buffer, size_t size);
+bool page_memstat (struct memstat *ms);
+bool page_table_fork (struct thread *parent);
 
 #endif /* vm/page.h */
@@ -0,0 +1,90 @@
+#include "vm/stats.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Statistics of each event.  Events happen in page faults as well
+   as in the page-out daemon, so they are updated with interrupts
+   off. */
+static struct vmstat stats[VM_EVENT_CNT];
+
+/* Names of the events, for vm_stats_print(). */
+static const char *event_names[VM_EVENT_CNT] =
+  {
+    "minor faults", "swap-ins", "file-ins", "evictions",
+    "clock scans", "stack growths",
+  };
+
+/* Records an occurrence of EVENT with the given VALUE. */
+void
+vm_stats_record (enum vm_event event, uint64_t value)
+{
+  struct vmstat *vs;
+  enum intr_level old_level;
+  int bucket = 0;
+
+  ASSERT (event < VM_EVENT_CNT);
+
+  while (bucket < VMSTAT_BUCKETS - 1 && value >> (bucket + 1) != 0)
+    bucket++;
+
+  vs = &stats[event];
+  old_level = intr_disable ();
+  vs->count++;
+  vs->total += value;
+  if (value > vs->max)
+    vs->max = value;
+  vs->buckets[bucket]++;
+  intr_set_level (old_level);
+}
+
+/* Records an occurrence of EVENT that took the cycles since
+   START, as returned by vm_stats_now(). */
+void
+vm_stats_since (enum vm_event event, uint64_t start)
+{
+  vm_stats_record (event, vm_stats_now () - start);
+}
+
+/* Copies the statistics of EVENT into VS.  Returns false if there
+   is no such event. */
+bool
+vm_stats_get (int event, struct vmstat *vs)
+{
+  struct vmstat copy;
+  enum intr_level old_level;
+
+  if (event < 0 || event >= VM_EVENT_CNT)
+    return false;
+
+  old_level = intr_disable ();
+  copy = stats[event];
+  intr_set_level (old_level);
+
+  *vs = copy;
+  return true;
+}
+
+/* Prints the statistics of each event that happened, with the
+   non-empty buckets of its histogram. */
+void
+vm_stats_print (void)
+{
+  int event, bucket;
+
+  for (event = 0; event < VM_EVENT_CNT; event++)
+    {
+      const struct vmstat *vs = &stats[event];
+
+      if (vs->count == 0)
+        continue;
+
+      printf ("VM: %llu %s, %llu %s on average, at most %llu;",
+              vs->count, event_names[event], vs->total / vs->count,
+              event == VM_CLOCK_SCAN ? "frames" : "cycles", vs->max);
+      for (bucket = 0; bucket < VMSTAT_BUCKETS; bucket++)
+        if (vs->buckets[bucket] != 0)
+          printf (" 2^%d:%u", bucket, vs->buckets[bucket]);
+      printf ("\n");
+    }
+}
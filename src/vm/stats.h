@@ -0,0 +1,22 @@
+#ifndef VM_STATS_H
+#define VM_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vmstat.h>
+
+/* Returns the CPU's time stamp counter, in cycles. */
+static inline uint64_t
+vm_stats_now (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+void vm_stats_record (enum vm_event event, uint64_t value);
+void vm_stats_since (enum vm_event event, uint64_t start);
+bool vm_stats_get (int event, struct vmstat *vs);
+void vm_stats_print (void);
+
+#endif /* vm/stats.h */
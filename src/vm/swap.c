@@ -1,8 +1,13 @@
 #include "vm/swap.h"
 #include <bitmap.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/disk.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "vm/lz.h"
 
 #define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
 
@@ -10,6 +15,90 @@
 static struct bitmap *swap_table = NULL;
 static struct lock swap_lock;
 
+/* Number of references to each swap slot.  Pages of forked
+   processes share their slots, and the evictor holds a reference
+   while it fills a slot. */
+static unsigned *swap_refs = NULL;
+
+/* Where the search for free slots starts.  Slots are handed out
+   in ascending order, so that pages evicted one after another end
+   up next to each other on disk. */
+static size_t swap_cursor = 0;
+
+/* Compressed swap cache.  swap_out() first tries to compress a
+   page into a block from the kernel heap, so that swapping the page
+   back in costs no disk I/O.  Compressed pages have swap indexes of
+   their own, above those of the disk slots, so the cache works
+   without a swap disk and is not limited by the number of slots.
+   When it is full, its oldest pages are written back to disk to
+   make room.  Pages that do not compress well enough go to disk
+   directly. */
+struct zpage
+  {
+    size_t size;                /* Size of the compressed data. */
+    uint8_t data[];             /* Compressed data. */
+  };
+
+/* A compressed page, swap index SLOT_CNT + its index in ZENTRIES. */
+struct zentry
+  {
+    struct zpage *z;            /* Compressed data, or NULL on disk. */
+    size_t slot;                /* Disk slot once written back. */
+    unsigned refs;              /* Number of references. */
+    struct list_elem elem;      /* Entry in zcache_lru while in memory. */
+  };
+
+/* Number of disk slots. */
+static size_t slot_cnt;
+
+/* Compressed pages, and which of them are in use. */
+static struct zentry *zentries = NULL;
+static struct bitmap *zentry_map = NULL;
+
+/* Compressed pages in memory, oldest first. */
+static struct list zcache_lru;
+
+/* Bytes of compressed pages in the cache. */
+static size_t zcache_bytes = 0;
+
+/* -zs: Maximum size of the cache in bytes. */
+size_t zcache_limit = 256 * 1024;
+
+/* Cache bytes per compressed page assumed to size ZENTRIES.  Once
+   all entries are used, pages go to disk directly even if the cache
+   has room. */
+#define ZENTRY_BYTES 128
+
+/* Largest compressed page kept.  Larger blocks would take a whole
+   page from malloc(), which saves no memory. */
+#define ZPAGE_MAX (1024 - sizeof (struct zpage))
+
+/* Compression state, protected by zcache_lock, which is also held
+   while decompressing a page or writing it back to disk, so that
+   its data stays put.  Everything else, including ZENTRIES,
+   ZCACHE_LRU and ZCACHE_BYTES, is protected by swap_lock.  If both
+   are needed, zcache_lock is acquired first. */
+static struct lock zcache_lock;
+static uint16_t lz_table[LZ_HASH_SIZE];
+static uint8_t lz_buffer[ZPAGE_MAX];
+static uint8_t spill_buffer[PGSIZE];
+
+/* Statistics. */
+static long long zcache_out_cnt;      /* # of pages compressed. */
+static long long zcache_in_cnt;       /* # of pages decompressed. */
+static long long zcache_spill_cnt;    /* # of pages written back. */
+static long long disk_out_cnt;        /* # of pages written to disk. */
+static long long disk_in_cnt;         /* # of pages read from disk. */
+
+static size_t alloc_slots (size_t cnt);
+static unsigned *ref_cnt (size_t swap_idx);
+static void drop_ref (size_t swap_idx);
+static void write_slot (size_t slot, const void *address);
+static void read_slot (size_t slot, void *address);
+static size_t zcache_out (void *address);
+static size_t zcache_in (size_t swap_idx, void *address);
+static bool zcache_make_room (size_t bytes);
+
 static inline struct disk *
 get_swap (void)
 {
@@ -21,19 +110,25 @@ void
 swap_init (void)
 {
   struct disk *swap = get_swap ();
-  size_t size;
+  size_t zentry_cnt = zcache_limit / ZENTRY_BYTES;
 
   if (swap == NULL)
-    size = 0;
+    slot_cnt = 0;
   else
-    size = disk_size (swap);
+    slot_cnt = disk_size (swap) / SECTORS_PER_PAGE;
 
-  swap_table = bitmap_create (size / SECTORS_PER_PAGE);
+  swap_table = bitmap_create (slot_cnt);
+  swap_refs = calloc (slot_cnt + 1, sizeof *swap_refs);
+  zentry_map = bitmap_create (zentry_cnt);
+  zentries = calloc (zentry_cnt + 1, sizeof *zentries);
 
-  if (swap_table == NULL)
+  if (swap_table == NULL || swap_refs == NULL
+      || zentry_map == NULL || zentries == NULL)
     PANIC ("Could not initialize swap.");
 
+  list_init (&zcache_lru);
   lock_init (&swap_lock);
+  lock_init (&zcache_lock);
 }
 
 /* Destroys the swap table (never actually called??) */
@@ -41,57 +136,349 @@ void
 swap_destroy (void)
 {
   bitmap_destroy (swap_table);
+  free (swap_refs);
+  bitmap_destroy (zentry_map);
+  free (zentries);
 }
 
-/* Swap out a page from the address into the swap partition. */
-bool
-swap_out (void *address, size_t *swap_out_idx)
+/* Reserves a run of up to *CNT contiguous swap slots on disk,
+   preferring longer runs, and stores the number of slots in *CNT.
+   The caller holds one reference to each slot, which it drops with
+   swap_free() once done.
+   Returns the index of the first slot, or SWAP_IDX_NONE if the
+   swap disk is full. */
+size_t
+swap_reserve (size_t *cnt)
 {
-  size_t swap_idx;
-  disk_sector_t sec_no;
+  size_t swap_idx = SWAP_IDX_NONE;
 
   lock_acquire (&swap_lock);
-  swap_idx = bitmap_scan_and_flip (swap_table, 0, 1, false);
+  for (; *cnt > 0; *cnt /= 2)
+    {
+      swap_idx = alloc_slots (*cnt);
+      if (swap_idx != SWAP_IDX_NONE)
+        break;
+    }
   lock_release (&swap_lock);
 
-  if (swap_idx == BITMAP_ERROR)
-    return false;
+  return swap_idx;
+}
 
-  for (sec_no = 0; sec_no < SECTORS_PER_PAGE; sec_no ++)
+/* Swaps out the page at ADDRESS and stores its swap index in
+   *SWAP_IDX, with the reference to it the caller held to the disk
+   slot *SWAP_IDX before.  If *SWAP_IDX is SWAP_IDX_NONE, the caller
+   gets a new reference.  The page is kept compressed in memory if
+   possible, and written to disk slot *SWAP_IDX otherwise, which is
+   allocated first, as by swap_reserve(), if needed.
+   Returns false if the swap disk is full. */
+bool
+swap_out (void *address, size_t *swap_idx)
+{
+  size_t zidx = zcache_out (address);
+
+  if (zidx != SWAP_IDX_NONE)
     {
-      disk_write (get_swap (), swap_idx * SECTORS_PER_PAGE + sec_no,
-                  address + sec_no * DISK_SECTOR_SIZE);
+      if (*swap_idx != SWAP_IDX_NONE)
+        swap_free (*swap_idx);
+      *swap_idx = zidx;
+      return true;
     }
 
-  *swap_out_idx = swap_idx;
+  if (*swap_idx == SWAP_IDX_NONE)
+    {
+      size_t cnt = 1;
+      *swap_idx = swap_reserve (&cnt);
+      if (*swap_idx == SWAP_IDX_NONE)
+        return false;
+    }
+
+  ASSERT (*swap_idx < slot_cnt && bitmap_test (swap_table, *swap_idx));
+
+  write_slot (*swap_idx, address);
+  disk_out_cnt++;
 
   return true;
 }
 
-/* Swap the frame KPAGE in for the given PAGE. */
+/* Swap the frame KPAGE in for the given PAGE.
+   This drops the page's reference to the swap slot. */
 void
 swap_in (size_t swap_idx, void *address)
+{
+  size_t slot = swap_idx;
+
+  if (swap_idx >= slot_cnt)
+    slot = zcache_in (swap_idx, address);
+
+  if (slot != SWAP_IDX_NONE)
+    {
+      read_slot (slot, address);
+      disk_in_cnt++;
+    }
+
+  swap_free (swap_idx);
+}
+
+/* Adds a reference to the swap slot, for another page with the
+   same contents. */
+void
+swap_dup (size_t swap_idx)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (*ref_cnt (swap_idx) > 0);
+  (*ref_cnt (swap_idx))++;
+  lock_release (&swap_lock);
+}
+
+/* Drops a reference to the swap slot, and frees it with the last
+   one. */
+void
+swap_free (size_t swap_idx)
+{
+  swap_free_batch (&swap_idx, 1);
+}
+
+/* Drops a reference to each of the CNT swap slots in SWAP_IDX,
+   like swap_free(), under a single acquisition of the swap
+   lock. */
+void
+swap_free_batch (const size_t *swap_idx, size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+
+  lock_acquire (&swap_lock);
+  for (i = 0; i < cnt; i++)
+    drop_ref (swap_idx[i]);
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages compressed, %lld decompressed, "
+          "%lld written back, %lld written to disk, "
+          "%lld read from disk, %zu bytes compressed in memory\n",
+          zcache_out_cnt, zcache_in_cnt, zcache_spill_cnt, disk_out_cnt,
+          disk_in_cnt, zcache_bytes);
+}
+
+/* Allocates CNT contiguous free slots at or after the cursor,
+   wrapping around to the start of the disk if needed.
+   Returns the index of the first slot, or SWAP_IDX_NONE. */
+static size_t
+alloc_slots (size_t cnt)
+{
+  size_t swap_idx, i;
+
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  swap_idx = bitmap_scan_and_flip (swap_table, swap_cursor, cnt, false);
+  if (swap_idx == BITMAP_ERROR)
+    swap_idx = bitmap_scan_and_flip (swap_table, 0, cnt, false);
+  if (swap_idx == BITMAP_ERROR)
+    return SWAP_IDX_NONE;
+
+  for (i = 0; i < cnt; i++)
+    swap_refs[swap_idx + i] = 1;
+  swap_cursor = swap_idx + cnt;
+
+  return swap_idx;
+}
+
+/* Returns the reference count of SWAP_IDX, a disk slot or a
+   compressed page. */
+static unsigned *
+ref_cnt (size_t swap_idx)
+{
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  if (swap_idx < slot_cnt)
+    return &swap_refs[swap_idx];
+
+  ASSERT (bitmap_test (zentry_map, swap_idx - slot_cnt));
+  return &zentries[swap_idx - slot_cnt].refs;
+}
+
+/* Drops a reference to SWAP_IDX, and frees it with the last one.
+   A compressed page is removed from the cache, or from the disk
+   slot it was written back to. */
+static void
+drop_ref (size_t swap_idx)
+{
+  struct zentry *e;
+
+  ASSERT (*ref_cnt (swap_idx) > 0);
+  if (--*ref_cnt (swap_idx) > 0)
+    return;
+
+  if (swap_idx < slot_cnt)
+    {
+      bitmap_set (swap_table, swap_idx, false);
+      return;
+    }
+
+  e = &zentries[swap_idx - slot_cnt];
+  if (e->z != NULL)
+    {
+      list_remove (&e->elem);
+      zcache_bytes -= sizeof *e->z + e->z->size;
+      free (e->z);
+      e->z = NULL;
+    }
+  else
+    drop_ref (e->slot);
+  bitmap_set (zentry_map, swap_idx - slot_cnt, false);
+}
+
+/* Writes the page at ADDRESS to disk slot SLOT. */
+static void
+write_slot (size_t slot, const void *address)
 {
   disk_sector_t sec_no;
 
-  ASSERT (bitmap_test (swap_table, swap_idx));
+  for (sec_no = 0; sec_no < SECTORS_PER_PAGE; sec_no ++)
+    {
+      disk_write (get_swap (), slot * SECTORS_PER_PAGE + sec_no,
+                  address + sec_no * DISK_SECTOR_SIZE);
+    }
+}
+
+/* Reads disk slot SLOT into the page at ADDRESS. */
+static void
+read_slot (size_t slot, void *address)
+{
+  disk_sector_t sec_no;
 
   for (sec_no = 0; sec_no < SECTORS_PER_PAGE; sec_no ++)
     {
-      disk_read (get_swap (), swap_idx * SECTORS_PER_PAGE + sec_no,
+      disk_read (get_swap (), slot * SECTORS_PER_PAGE + sec_no,
                  address + sec_no * DISK_SECTOR_SIZE);
     }
+}
+
+/* Tries to keep the page at ADDRESS compressed in memory.
+   Returns its swap index, with one reference for the caller, or
+   SWAP_IDX_NONE if it does not compress to ZPAGE_MAX bytes or no
+   room can be made for it. */
+static size_t
+zcache_out (void *address)
+{
+  struct zentry *e;
+  struct zpage *z = NULL;
+  size_t size, idx = BITMAP_ERROR;
+
+  lock_acquire (&zcache_lock);
+  size = lz_compress (address, PGSIZE, lz_buffer, ZPAGE_MAX, lz_table);
+  if (size > 0)
+    {
+      lock_acquire (&swap_lock);
+      idx = bitmap_scan_and_flip (zentry_map, 0, 1, false);
+      lock_release (&swap_lock);
+    }
+  if (idx != BITMAP_ERROR && zcache_make_room (sizeof *z + size))
+    z = malloc (sizeof *z + size);
 
   lock_acquire (&swap_lock);
-  bitmap_set (swap_table, swap_idx, false);
+  if (z != NULL)
+    {
+      z->size = size;
+      memcpy (z->data, lz_buffer, size);
+      e = &zentries[idx];
+      e->z = z;
+      e->refs = 1;
+      list_push_back (&zcache_lru, &e->elem);
+      zcache_bytes += sizeof *z + size;
+      zcache_out_cnt++;
+    }
+  else if (idx != BITMAP_ERROR)
+    bitmap_set (zentry_map, idx, false);
   lock_release (&swap_lock);
+  lock_release (&zcache_lock);
+
+  return z != NULL ? slot_cnt + idx : SWAP_IDX_NONE;
 }
 
-/* Free the swap. */
-void
-swap_free (size_t swap_idx)
+/* Decompresses the compressed page SWAP_IDX, which the caller
+   holds a reference to, into the page at ADDRESS.  Returns
+   SWAP_IDX_NONE, or the disk slot to read instead if the page has
+   been written back to disk. */
+static size_t
+zcache_in (size_t swap_idx, void *address)
 {
+  struct zentry *e = &zentries[swap_idx - slot_cnt];
+  struct zpage *z;
+  size_t slot;
+
+  lock_acquire (&zcache_lock);
   lock_acquire (&swap_lock);
-  bitmap_set (swap_table, swap_idx, false);
+  ASSERT (e->refs > 0);
+  z = e->z;
+  slot = e->slot;
   lock_release (&swap_lock);
+
+  if (z != NULL)
+    {
+      if (!lz_decompress (z->data, z->size, address, PGSIZE))
+        PANIC ("corrupt compressed swap page %zu", swap_idx);
+      zcache_in_cnt++;
+      slot = SWAP_IDX_NONE;
+    }
+  lock_release (&zcache_lock);
+
+  return slot;
+}
+
+/* Writes the oldest compressed pages back to disk until BYTES more
+   fit into the cache.  Their swap indexes stay the same.  Returns
+   false if there is not enough room and no free disk slot. */
+static bool
+zcache_make_room (size_t bytes)
+{
+  ASSERT (lock_held_by_current_thread (&zcache_lock));
+
+  if (bytes > zcache_limit)
+    return false;
+
+  while (true)
+    {
+      struct zentry *e;
+      size_t slot;
+
+      lock_acquire (&swap_lock);
+      if (zcache_bytes + bytes <= zcache_limit)
+        {
+          lock_release (&swap_lock);
+          return true;
+        }
+      ASSERT (!list_empty (&zcache_lru));
+      slot = alloc_slots (1);
+      if (slot == SWAP_IDX_NONE)
+        {
+          lock_release (&swap_lock);
+          return false;
+        }
+
+      /* Keep the page while it is written. */
+      e = list_entry (list_pop_front (&zcache_lru), struct zentry, elem);
+      e->refs++;
+      lock_release (&swap_lock);
+
+      if (!lz_decompress (e->z->data, e->z->size, spill_buffer, PGSIZE))
+        PANIC ("corrupt compressed swap page %zu",
+               slot_cnt + (size_t) (e - zentries));
+      write_slot (slot, spill_buffer);
+      zcache_spill_cnt++;
+
+      lock_acquire (&swap_lock);
+      zcache_bytes -= sizeof *e->z + e->z->size;
+      free (e->z);
+      e->z = NULL;
+      e->slot = slot;
+      drop_ref (slot_cnt + (e - zentries));
+      lock_release (&swap_lock);
+    }
 }
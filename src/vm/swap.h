@@ -3,12 +3,23 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+/* Swap index that refers to no swap slot. */
+#define SWAP_IDX_NONE SIZE_MAX
+
+/* Compressed swap cache size, see swap.c. */
+extern size_t zcache_limit;
 
 void swap_init (void);
 void swap_destroy (void);
 
-bool swap_out (void *address, size_t *swap_out_idx);
+size_t swap_reserve (size_t *cnt);
+bool swap_out (void *address, size_t *swap_idx);
 void swap_in (size_t swap_idx, void *address);
+void swap_dup (size_t swap_idx);
 void swap_free (size_t swap_idx);
+void swap_free_batch (const size_t *swap_idx, size_t cnt);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */
@@ -0,0 +1,178 @@
+#include "vm/vma.h"
+#include <debug.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+static struct vma *copy_vma (const struct vma *pv, struct thread *parent);
+
+/* Initializes the list of virtual memory areas of a process. */
+void
+vma_table_init (struct list *vmas)
+{
+  list_init (vmas);
+}
+
+/* Frees the virtual memory areas in VMAS, whose pages must have
+   been destroyed already.  Called by process_exit(). */
+void
+vma_table_destroy (struct list *vmas)
+{
+  while (!list_empty (vmas))
+    {
+      struct vma *v = list_entry (list_pop_front (vmas), struct vma, elem);
+      ASSERT (list_empty (&v->pages));
+      free (v);
+    }
+}
+
+/* Adds a virtual memory area of SIZE bytes at the page-aligned
+   address START to the current process.  Its pages hold the
+   READ_BYTES bytes at offset OFS in FILE, followed by zeros.
+   FILE may be a null pointer if READ_BYTES is 0.  If MMAP is
+   true, modified pages are written back to FILE.
+   Returns a null pointer if the area overlaps another one or
+   memory allocation fails. */
+struct vma *
+vma_create (void *start, size_t size, bool writable, struct file *file,
+            off_t ofs, size_t read_bytes, bool mmap)
+{
+  struct thread *t = thread_current ();
+  uint8_t *end = (uint8_t *) start + ROUND_UP (size, PGSIZE);
+  struct list_elem *e;
+  struct vma *v;
+
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (read_bytes <= size);
+  ASSERT (file != NULL || read_bytes == 0);
+
+  if (size == 0 || !is_user_vaddr (start) || end > (uint8_t *) PHYS_BASE
+      || end < (uint8_t *) start || !vma_is_free (start, end))
+    return NULL;
+
+  v = malloc (sizeof *v);
+  if (v == NULL)
+    return NULL;
+
+  v->start = start;
+  v->end = end;
+  v->writable = writable;
+  v->file = file;
+  v->ofs = ofs;
+  v->read_bytes = read_bytes;
+  v->mmap = mmap;
+  list_init (&v->pages);
+
+  /* Keep the list sorted by address. */
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas); e = list_next (e))
+    if (list_entry (e, struct vma, elem)->start > v->start)
+      break;
+  list_insert (e, &v->elem);
+
+  return v;
+}
+
+/* Destroys the pages of virtual memory area V, writing back
+   modified pages of a memory-mapped file, and removes V from the
+   current process. */
+void
+vma_destroy (struct vma *v)
+{
+  while (!list_empty (&v->pages))
+    page_free (list_entry (list_front (&v->pages), struct page, vma_elem));
+
+  list_remove (&v->elem);
+  free (v);
+}
+
+/* Returns the virtual memory area of the current process that
+   contains UADDR, or a null pointer if there is none. */
+struct vma *
+vma_find (const void *uaddr)
+{
+  struct list *vmas = &thread_current ()->vmas;
+  struct list_elem *e;
+
+  for (e = list_begin (vmas); e != list_end (vmas); e = list_next (e))
+    {
+      struct vma *v = list_entry (e, struct vma, elem);
+      if ((const uint8_t *) uaddr < v->start)
+        break;
+      if ((const uint8_t *) uaddr < v->end)
+        return v;
+    }
+
+  return NULL;
+}
+
+/* Returns true if no virtual memory area of the current process
+   overlaps the range from START up to END. */
+bool
+vma_is_free (const void *start, const void *end)
+{
+  struct list *vmas = &thread_current ()->vmas;
+  struct list_elem *e;
+
+  for (e = list_begin (vmas); e != list_end (vmas); e = list_next (e))
+    {
+      struct vma *v = list_entry (e, struct vma, elem);
+      if ((const uint8_t *) end <= v->start)
+        break;
+      if ((const uint8_t *) start < v->end)
+        return false;
+    }
+
+  return true;
+}
+
+/* Copies the virtual memory areas of PARENT, which must be
+   blocked, into the current process for fork(), except for
+   memory-mapped files.  Returns false if memory allocation
+   fails. */
+bool
+vma_table_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->vmas); e != list_end (&parent->vmas);
+       e = list_next (e))
+    {
+      struct vma *pv = list_entry (e, struct vma, elem);
+      struct vma *v;
+
+      if (pv->mmap)
+        continue;
+
+      v = copy_vma (pv, parent);
+      if (v == NULL)
+        return false;
+      list_push_back (&t->vmas, &v->elem);
+      if (pv == parent->stack_vma)
+        t->stack_vma = v;
+    }
+
+  return true;
+}
+
+/* Returns a copy of PARENT's virtual memory area PV without any
+   pages, or a null pointer if memory allocation fails. */
+static struct vma *
+copy_vma (const struct vma *pv, struct thread *parent)
+{
+  struct vma *v = malloc (sizeof *v);
+
+  if (v == NULL)
+    return NULL;
+
+  *v = *pv;
+  list_init (&v->pages);
+
+  /* The executable is read from our own copy of it. */
+  if (pv->file != NULL && pv->file == parent->exec)
+    v->file = thread_current ()->exec;
+
+  return v;
+}
@@ -0,0 +1,40 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct thread;
+
+/* Virtual memory area: a range of pages of a process with the
+   same protection and backing store.  Supplemental page table
+   entries for the pages are only created when they are first
+   used, see page_load(). */
+struct vma
+  {
+    uint8_t *start;             /* First page. */
+    uint8_t *end;               /* Byte after the last page. */
+    bool writable;              /* Pages are writable or not. */
+    struct file *file;          /* Backing file, or NULL for zeros. */
+    off_t ofs;                  /* Offset of START in FILE. */
+    size_t read_bytes;          /* Bytes of FILE, the rest is zeros. */
+    bool mmap;                  /* Written back to FILE, not swap. */
+    struct list pages;          /* Pages created so far. */
+    struct list_elem elem;      /* Entry in thread's list, by address. */
+  };
+
+void vma_table_init (struct list *vmas);
+void vma_table_destroy (struct list *vmas);
+struct vma *vma_create (void *start, size_t size, bool writable,
+                        struct file *file, off_t ofs, size_t read_bytes,
+                        bool mmap);
+void vma_destroy (struct vma *v);
+struct vma *vma_find (const void *uaddr);
+bool vma_is_free (const void *start, const void *end);
+bool vma_table_fork (struct thread *parent);
+
+#endif /* vm/vma.h */